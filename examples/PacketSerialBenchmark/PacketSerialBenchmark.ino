@@ -0,0 +1,521 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+// This example checks that the run-based encoders produce the same results as
+// the byte-at-a-time reference encoders, then measures the throughput of each
+// on the current board and prints the results as plain text. It then measures
+// the CRC kernels and compares checking a CRC while decoding (as done by
+// CheckedEncoder) with checking it in a separate pass. It measures the RLE and
+// LZ compressors on sensor-like data and prints their compression ratio.
+//
+// Finally it measures the cost of PacketSerial::update() per received byte by
+// replaying encoded packets from memory, including packets that overflow the
+// receive buffer with and without resync mode. It compares the cost of calling
+// the packet handler through a function pointer with an InlinePacketSerial
+// handler, and counts the Stream::write() calls needed to send small packets
+// with and without batching. Unlike the other examples, it does not send or
+// receive packets over Serial, so open the Serial Monitor to see the results.
+//
+// To compare the byte-at-a-time and chunked update() paths, run the example a
+// second time with the following line uncommented.
+//
+// #define PACKETSERIAL_READ_CHUNK_SIZE 64
+//
+// To compare the CRC kernels, set the number of bytes processed per table
+// lookup to 0 (bitwise), 1 (one table), 4 or 8 (slice-by-N).
+//
+// #define PACKETSERIAL_CRC_SLICES 8
+
+#include <PacketSerial.h>
+#include <CompressedPacketSerial.h>
+
+
+// The number of bytes in each test packet.
+#if defined(__AVR__)
+const size_t PACKET_SIZE = 128;
+#else
+const size_t PACKET_SIZE = 1024;
+#endif
+
+// The minimum duration of each measurement in milliseconds.
+const unsigned long DURATION = 500;
+
+// The number of packets received by each update() measurement.
+const size_t PACKET_COUNT = 16;
+
+// The number of bytes in each small packet sent by the write measurements.
+const size_t TELEMETRY_SIZE = 16;
+
+// The number of small packets sent by each write measurement.
+const size_t TELEMETRY_COUNT = 100;
+
+// The size of the transmit queue used by the write measurements.
+#if defined(__AVR__)
+const size_t TRANSMIT_BUFFER_SIZE = 128;
+#else
+const size_t TRANSMIT_BUFFER_SIZE = 512;
+#endif
+
+uint8_t packet[PACKET_SIZE];
+uint8_t encoded[PACKET_SIZE * 2 + 2];
+size_t encodedSize = 0;
+
+// Scratch buffers for decoded packets and for comparing the encoders.
+uint8_t expected[PACKET_SIZE * 2 + 2];
+uint8_t actual[PACKET_SIZE * 2 + 2];
+
+// Keeps the compiler from removing the CRC computations.
+volatile uint32_t checksum = 0;
+
+
+// A Stream that endlessly replays the bytes of a buffer and discards writes.
+//
+// Only `budget` bytes can be read before the next call to refill(), and
+// available() reports at most `chunk` bytes at a time, which simulates a
+// serial port that receives bytes in bursts. The number of write() calls is
+// counted, because on USB CDC cores each call can become a USB transfer.
+class LoopbackStream: public Stream
+{
+public:
+  void setBuffer(const uint8_t* buffer, size_t size, size_t chunk)
+  {
+    _buffer = buffer;
+    _size = size;
+    _chunk = chunk;
+    _index = 0;
+    _budget = 0;
+  }
+
+  void refill(size_t budget)
+  {
+    _budget = budget;
+  }
+
+  int available() override
+  {
+    return _budget < _chunk ? _budget : _chunk;
+  }
+
+  int read() override
+  {
+    int data = peek();
+
+    if (data >= 0)
+    {
+      _index = (_index + 1) % _size;
+      _budget--;
+    }
+
+    return data;
+  }
+
+  int peek() override
+  {
+    return _budget > 0 ? _buffer[_index] : -1;
+  }
+
+  size_t write(uint8_t) override
+  {
+    _writes++;
+    return 1;
+  }
+
+  size_t write(const uint8_t*, size_t size) override
+  {
+    _writes++;
+    return size;
+  }
+
+  int availableForWrite() override
+  {
+    return 512;
+  }
+
+  size_t writes()
+  {
+    size_t writes = _writes;
+    _writes = 0;
+    return writes;
+  }
+
+  void flush()
+  {
+  }
+
+private:
+  const uint8_t* _buffer = nullptr;
+  size_t _size = 0;
+  size_t _chunk = 1;
+  size_t _index = 0;
+  size_t _budget = 0;
+  size_t _writes = 0;
+};
+
+
+LoopbackStream loopbackStream;
+size_t packetsReceived = 0;
+
+
+void onPacketReceived(const uint8_t* /* buffer */, size_t /* size */)
+{
+  packetsReceived++;
+}
+
+
+// Repeatedly receive PACKET_COUNT packets from the loopback stream for at
+// least DURATION milliseconds and print the cost of update() per byte and per
+// packet. The packet handler must already be set.
+template<typename PacketSerialType>
+void measureUpdate(const __FlashStringHelper* name, PacketSerialType& packetSerial)
+{
+  packetSerial.setStream(&loopbackStream);
+  packetsReceived = 0;
+
+  unsigned long bytes = 0;
+  unsigned long start = micros();
+  unsigned long elapsed = 0;
+
+  do
+  {
+    loopbackStream.refill(encodedSize * PACKET_COUNT);
+    packetSerial.update();
+    bytes += encodedSize * PACKET_COUNT;
+    elapsed = micros() - start;
+  }
+  while (elapsed < DURATION * 1000UL);
+
+  Serial.print(name);
+  Serial.print(F(": "));
+  Serial.print(float(elapsed) * 1000 / bytes, 2);
+  Serial.print(F(" ns/byte, "));
+
+  if (packetsReceived > 0)
+  {
+    Serial.print(float(elapsed) * 1000 / packetsReceived, 2);
+    Serial.print(F(" ns/packet, "));
+  }
+
+  Serial.print(packetsReceived);
+  Serial.println(F(" packets"));
+}
+
+
+// Each function processes one packet so it can be measured by measure().
+// Send TELEMETRY_COUNT small packets, calling update() after each one as a
+// loop() would, and print the number of Stream::write() calls per packet.
+template<typename PacketSerialType>
+void measureWrites(const __FlashStringHelper* name, PacketSerialType& packetSerial)
+{
+  packetSerial.setStream(&loopbackStream);
+  loopbackStream.writes();
+
+  for (size_t i = 0; i < TELEMETRY_COUNT; i++)
+  {
+    packetSerial.send(packet, TELEMETRY_SIZE);
+    packetSerial.update();
+  }
+
+  packetSerial.flush();
+
+  Serial.print(name);
+  Serial.print(F(": "));
+  Serial.print(float(loopbackStream.writes()) / TELEMETRY_COUNT, 2);
+  Serial.println(F(" writes/packet"));
+}
+
+
+void cobsEncodeBytes() { encodedSize = COBS::encodeBytes(packet, PACKET_SIZE, encoded); }
+void cobsEncodeRuns() { encodedSize = COBS::encodeRuns(packet, PACKET_SIZE, encoded); }
+void cobsDecodeBytes() { COBS::decodeBytes(encoded, encodedSize, actual); }
+void cobsDecodeRuns() { COBS::decodeRuns(encoded, encodedSize, actual); }
+void slipEncodeBytes() { encodedSize = SLIP::encodeBytes(packet, PACKET_SIZE, encoded); }
+void slipEncodeRuns() { encodedSize = SLIP::encodeRuns(packet, PACKET_SIZE, encoded); }
+void slipDecodeBytes() { SLIP::decodeBytes(encoded, encodedSize, actual); }
+void slipDecodeRuns() { SLIP::decodeRuns(encoded, encodedSize, actual); }
+void crc16() { checksum = CRC16::compute(packet, PACKET_SIZE); }
+void crc32() { checksum = CRC32::compute(packet, PACKET_SIZE); }
+void crc32c() { checksum = CRC32C::compute(packet, PACKET_SIZE); }
+void rleCompress() { encodedSize = RLE::compress(packet, PACKET_SIZE, encoded, sizeof(encoded)); }
+void rleDecompress() { RLE::decompress(encoded, encodedSize, actual, sizeof(actual)); }
+void lzCompress() { encodedSize = LZ::compress(packet, PACKET_SIZE, encoded, sizeof(encoded)); }
+void lzDecompress() { LZ::decompress(encoded, encodedSize, actual, sizeof(actual)); }
+
+
+// Print the compressed size as a share of the packet size.
+void printRatio(const __FlashStringHelper* name)
+{
+  Serial.print(name);
+  Serial.print(F(": "));
+  Serial.print(encodedSize);
+  Serial.print(F(" bytes, ratio "));
+  Serial.println(float(encodedSize) / PACKET_SIZE, 3);
+}
+
+
+// Decode a checked packet one byte at a time, updating the CRC as each byte
+// is decoded. This is what update() does for a CheckedEncoder.
+void crc32Fused()
+{
+  CheckedEncoder<COBS, CRC32>::StreamDecoder decoder;
+  size_t size = 0;
+
+  for (size_t i = 0; i < encodedSize; i++)
+  {
+    if (decoder.decode(encoded[i], actual[size]))
+      size++;
+  }
+
+  checksum = decoder.isValid();
+}
+
+
+// Decode a checked packet one byte at a time, then check the CRC in a second
+// pass over the decoded packet.
+void crc32Separate()
+{
+  COBS::StreamDecoder decoder;
+  size_t size = 0;
+
+  for (size_t i = 0; i < encodedSize; i++)
+  {
+    if (decoder.decode(encoded[i], actual[size]))
+      size++;
+  }
+
+  checksum = decoder.isValid() && CRC32::check(CRC32::update(CRC32::begin(), actual, size));
+}
+
+
+void setup()
+{
+  Serial.begin(115200);
+
+  while (!Serial) {;}
+
+  randomSeed(42);
+
+  Serial.print(F("Reference check: "));
+  Serial.println(verify(1000) ? F("OK") : F("MISMATCH"));
+
+  // Fill the packet with pseudo-random bytes. Roughly one in 64 bytes is a
+  // byte that must be encoded.
+  fill(PACKET_SIZE, 64);
+
+  Serial.print(F("Packet size: "));
+  Serial.println(PACKET_SIZE);
+
+  measure(F("COBS::encodeBytes"), cobsEncodeBytes);
+  measure(F("COBS::encodeRuns "), cobsEncodeRuns);
+  measure(F("COBS::decodeBytes"), cobsDecodeBytes);
+  measure(F("COBS::decodeRuns "), cobsDecodeRuns);
+  measure(F("SLIP::encodeBytes"), slipEncodeBytes);
+  measure(F("SLIP::encodeRuns "), slipEncodeRuns);
+  measure(F("SLIP::decodeBytes"), slipDecodeBytes);
+  measure(F("SLIP::decodeRuns "), slipDecodeRuns);
+
+  Serial.print(F("CRC slices: "));
+  Serial.println(PACKETSERIAL_CRC_SLICES);
+
+  measure(F("CRC16            "), crc16);
+  measure(F("CRC32            "), crc32);
+  measure(F("CRC32C           "), crc32c);
+
+  encodedSize = CheckedEncoder<COBS, CRC32>::encode(packet, PACKET_SIZE, encoded);
+
+  measure(F("CRC32 fused      "), crc32Fused);
+  measure(F("CRC32 separate   "), crc32Separate);
+
+  fillSensorReadings();
+
+  measure(F("RLE::compress    "), rleCompress);
+  printRatio(F("RLE              "));
+  measure(F("RLE::decompress  "), rleDecompress);
+  measure(F("LZ::compress     "), lzCompress);
+  printRatio(F("LZ               "));
+  measure(F("LZ::decompress   "), lzDecompress);
+
+  fill(PACKET_SIZE, 64);
+
+  // Each PacketSerial_ is declared in its own block, so that only one of
+  // them is on the stack at a time.
+  encodedSize = COBS::encode(packet, PACKET_SIZE, encoded);
+  encoded[encodedSize++] = 0;
+  loopbackStream.setBuffer(encoded, encodedSize, 64);
+
+  {
+    PacketSerial_<COBS, 0, PACKET_SIZE> cobsPacketSerial;
+    cobsPacketSerial.setPacketHandler(&onPacketReceived);
+    measureUpdate(F("COBS update()"), cobsPacketSerial);
+  }
+
+  encodedSize = SLIP::encode(packet, PACKET_SIZE, encoded);
+  encoded[encodedSize++] = SLIP::END;
+  loopbackStream.setBuffer(encoded, encodedSize, 64);
+
+  {
+    PacketSerial_<SLIP, SLIP::END, PACKET_SIZE> slipPacketSerial;
+    slipPacketSerial.setPacketHandler(&onPacketReceived);
+    measureUpdate(F("SLIP update()"), slipPacketSerial);
+  }
+
+  // Every packet overflows a 64 byte receive buffer. Without resync mode the
+  // truncated packets are still decoded and passed to the packet handler.
+  encodedSize = COBS::encode(packet, PACKET_SIZE, encoded);
+  encoded[encodedSize++] = 0;
+  loopbackStream.setBuffer(encoded, encodedSize, 64);
+
+  {
+    PacketSerial_<COBS, 0, 64> truncatingPacketSerial;
+    truncatingPacketSerial.setPacketHandler(&onPacketReceived);
+    measureUpdate(F("Overflow        "), truncatingPacketSerial);
+  }
+
+  {
+    PacketSerial_<COBS, 0, 64> resyncPacketSerial;
+    resyncPacketSerial.setPacketHandler(&onPacketReceived);
+    resyncPacketSerial.setResyncOnOverflow(true);
+    measureUpdate(F("Overflow resync "), resyncPacketSerial);
+  }
+
+  // With 4 byte packets, update() mostly measures the packet dispatch.
+  encodedSize = COBS::encode(packet, 4, encoded);
+  encoded[encodedSize++] = 0;
+  loopbackStream.setBuffer(encoded, encodedSize, 64);
+
+  {
+    PacketSerial_<COBS, 0, PACKET_SIZE> pointerPacketSerial;
+    pointerPacketSerial.setPacketHandler(&onPacketReceived);
+    measureUpdate(F("Function pointer"), pointerPacketSerial);
+  }
+
+  {
+    InlinePacketSerial<PacketFunctionHandler<&onPacketReceived>, COBS, 0, PACKET_SIZE> inlinePacketSerial;
+    measureUpdate(F("Inline handler  "), inlinePacketSerial);
+  }
+
+  loopbackStream.setBuffer(encoded, encodedSize, 64);
+
+  {
+    PacketSerial_<COBS, 0, 64> directPacketSerial;
+    measureWrites(F("send()        "), directPacketSerial);
+  }
+
+  {
+    PacketSerial_<COBS, 0, 64, 64, TRANSMIT_BUFFER_SIZE> queuedPacketSerial;
+    measureWrites(F("queued send() "), queuedPacketSerial);
+  }
+
+  {
+    PacketSerial_<COBS, 0, 64, 64, TRANSMIT_BUFFER_SIZE> batchedPacketSerial;
+    batchedPacketSerial.setBatching(TRANSMIT_BUFFER_SIZE / 2, 1000);
+    measureWrites(F("batched send()"), batchedPacketSerial);
+  }
+}
+
+
+void loop()
+{
+}
+
+
+// Fill the packet with 16-bit little-endian sensor readings. The first quarter
+// of the channels read close to a baseline value and the others are unused
+// and read 0, as in a partially populated sensor array.
+void fillSensorReadings()
+{
+  for (size_t i = 0; i + 1 < PACKET_SIZE; i += 2)
+  {
+    uint16_t reading = i < PACKET_SIZE / 4 ? 1000 + random(2) : 0;
+    packet[i] = reading & 0xFF;
+    packet[i + 1] = reading >> 8;
+  }
+}
+
+
+// Fill the first size bytes of the packet with pseudo-random bytes. About one
+// in every rarity bytes is 0, SLIP::END or SLIP::ESC.
+void fill(size_t size, long rarity)
+{
+  const uint8_t special[3] = { 0, SLIP::END, SLIP::ESC };
+
+  for (size_t i = 0; i < size; i++)
+  {
+    packet[i] = random(rarity) == 0 ? special[random(3)] : random(256);
+  }
+}
+
+
+// Compare the run-based encoders with the reference encoders for a number of
+// random packets of random sizes. Returns true if all results are identical.
+bool verify(size_t iterations)
+{
+  for (size_t i = 0; i < iterations; i++)
+  {
+    size_t size = random(PACKET_SIZE + 1);
+    fill(size, random(1, 256));
+
+    size_t expectedSize = COBS::encodeBytes(packet, size, expected);
+    size_t actualSize = COBS::encodeRuns(packet, size, actual);
+
+    if (expectedSize != actualSize || memcmp(expected, actual, actualSize) != 0)
+      return false;
+
+    encodedSize = COBS::encodeBytes(packet, size, encoded);
+    expectedSize = COBS::decodeBytes(encoded, encodedSize, expected);
+    actualSize = COBS::decodeRuns(encoded, encodedSize, actual);
+
+    if (expectedSize != actualSize || memcmp(expected, actual, actualSize) != 0)
+      return false;
+
+    expectedSize = SLIP::encodeBytes(packet, size, expected);
+    actualSize = SLIP::encodeRuns(packet, size, actual);
+
+    if (expectedSize != actualSize || memcmp(expected, actual, actualSize) != 0)
+      return false;
+
+    encodedSize = SLIP::encodeBytes(packet, size, encoded);
+    expectedSize = SLIP::decodeBytes(encoded, encodedSize, expected);
+    actualSize = SLIP::decodeRuns(encoded, encodedSize, actual);
+
+    if (expectedSize != actualSize || memcmp(expected, actual, actualSize) != 0)
+      return false;
+  }
+
+  return true;
+}
+
+
+// Repeatedly call a function for at least DURATION milliseconds and print the
+// resulting throughput in MB/s and microseconds per packet.
+void measure(const __FlashStringHelper* name, void (*function)())
+{
+  unsigned long count = 0;
+  unsigned long start = micros();
+  unsigned long elapsed = 0;
+
+  do
+  {
+    function();
+    count++;
+    elapsed = micros() - start;
+  }
+  while (elapsed < DURATION * 1000UL);
+
+  float bytesPerMicrosecond = float(count) * PACKET_SIZE / elapsed;
+
+  Serial.print(name);
+  Serial.print(F(": "));
+  Serial.print(bytesPerMicrosecond, 3);
+  Serial.print(F(" MB/s, "));
+  Serial.print(float(elapsed) / count, 2);
+  Serial.print(F(" us/packet"));
+#if defined(F_CPU)
+  Serial.print(F(", "));
+  Serial.print(F_CPU / 1000000.0 / bytesPerMicrosecond, 1);
+  Serial.print(F(" cycles/byte"));
+#endif
+  Serial.println();
+}
@@ -0,0 +1,85 @@
+//
+// Copyright (c) 2012 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+// This example is PacketSerialReverseEcho modified to use QueuedPacketSerial,
+// which queues received packets instead of calling a packet handler.
+
+#include <QueuedPacketSerial.h>
+
+
+// By default, QueuedPacketSerial uses COBS encoding and can queue 4 packets of
+// up to 64 bytes each. This can be adjusted by the user by replacing
+// `QueuedPacketSerial` with a variation of the
+// `QueuedPacketSerial_<COBS, 0, SlotCount, SlotSize>` template found in
+// QueuedPacketSerial.h.
+QueuedPacketSerial myPacketSerial;
+
+
+void setup()
+{
+  // We begin communication with the Serial port and then let our
+  // QueuedPacketSerial object manage it.
+  Serial.begin(115200);
+  myPacketSerial.setStream(&Serial);
+}
+
+
+void loop()
+{
+  // Do your program-specific loop() work here as usual.
+
+  // The QueuedPacketSerial::update() method reads any incoming serial data and
+  // decodes complete packets directly into the queue.
+  myPacketSerial.update();
+
+  // Process all packets that arrived since the last loop(). The `buffer` is a
+  // pointer to the decoded packet inside the queue and stays valid until
+  // release() is called.
+  const uint8_t* buffer;
+  size_t size;
+
+  while (myPacketSerial.peek(buffer, size))
+  {
+    // In this example, we will simply reverse the contents of the array and
+    // send it back to the sender.
+
+    // Make a temporary buffer.
+    uint8_t tempBuffer[size];
+
+    // Copy the packet into our temporary buffer.
+    memcpy(tempBuffer, buffer, size);
+
+    // Return the slot to the queue.
+    myPacketSerial.release();
+
+    // Reverse our temporary buffer.
+    reverse(tempBuffer, size);
+
+    // Send the reversed buffer back to the sender.
+    myPacketSerial.send(tempBuffer, size);
+  }
+
+  // Check for dropped packets (optional).
+  if (myPacketSerial.dropped() > 0)
+  {
+    // Packets were dropped because the queue was full or the packets were
+    // larger than a slot. Consider calling update() more often or increasing
+    // the queue size via the template parameters.
+  }
+}
+
+// This function takes a byte buffer and reverses it.
+void reverse(uint8_t* buffer, size_t size)
+{
+  uint8_t tmp;
+
+  for (size_t i = 0; i < size / 2; i++)
+  {
+    tmp = buffer[i];
+    buffer[i] = buffer[size - i - 1];
+    buffer[size - i - 1] = tmp;
+  }
+}
@@ -0,0 +1,257 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+// A minimal Arduino.h for building PacketSerial on a POSIX host.
+//
+// It provides only the parts of the Arduino core that PacketSerial and its
+// examples use, and a `Serial` that prints to the standard output. Add this
+// directory to the include path, e.g.:
+//
+//     c++ -std=c++11 -I extras/host -I src my_program.cpp
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/// \brief The type of strings marked with F().
+///
+/// On a host, strings are never stored in flash, so F() only changes the
+/// type of the string so that the Print overloads for it are used.
+class __FlashStringHelper;
+
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+
+/// \brief Get the number of microseconds since an arbitrary point in time.
+inline unsigned long micros()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<unsigned long>(now.tv_sec) * 1000000UL + now.tv_nsec / 1000;
+}
+
+
+/// \brief Get the number of milliseconds since an arbitrary point in time.
+inline unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+
+/// \brief Get a pseudo-random number from 0 to \p howBig - 1.
+inline long random(long howBig)
+{
+    return howBig > 0 ? static_cast<long>(rand() % howBig) : 0;
+}
+
+
+/// \brief Get a pseudo-random number from \p howSmall to \p howBig - 1.
+inline long random(long howSmall, long howBig)
+{
+    return howSmall < howBig ? howSmall + random(howBig - howSmall) : howSmall;
+}
+
+
+/// \brief Seed the pseudo-random number generator used by random().
+inline void randomSeed(unsigned long seed)
+{
+    srand(static_cast<unsigned int>(seed));
+}
+
+
+/// \brief The byte output interface of the Arduino core.
+class Print
+{
+public:
+    virtual ~Print()
+    {
+    }
+
+    virtual size_t write(uint8_t data) = 0;
+
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        size_t count = 0;
+
+        while (size-- > 0 && write(*buffer++) == 1)
+        {
+            count++;
+        }
+
+        return count;
+    }
+
+    virtual int availableForWrite()
+    {
+        return 0;
+    }
+
+    virtual void flush()
+    {
+    }
+
+    size_t print(const char* string)
+    {
+        return write(reinterpret_cast<const uint8_t*>(string), strlen(string));
+    }
+
+    size_t print(const __FlashStringHelper* string)
+    {
+        return print(reinterpret_cast<const char*>(string));
+    }
+
+    size_t print(char data)
+    {
+        return write(static_cast<uint8_t>(data));
+    }
+
+    size_t print(int value)
+    {
+        return print(static_cast<long>(value));
+    }
+
+    size_t print(unsigned int value)
+    {
+        return print(static_cast<unsigned long>(value));
+    }
+
+    size_t print(long value)
+    {
+        char string[24];
+        snprintf(string, sizeof(string), "%ld", value);
+        return print(string);
+    }
+
+    size_t print(unsigned long value)
+    {
+        char string[24];
+        snprintf(string, sizeof(string), "%lu", value);
+        return print(string);
+    }
+
+    size_t print(double value, int digits = 2)
+    {
+        char string[64];
+        snprintf(string, sizeof(string), "%.*f", digits, value);
+        return print(string);
+    }
+
+    size_t println()
+    {
+        return print("\r\n");
+    }
+
+    template<typename T>
+    size_t println(const T& value)
+    {
+        size_t count = print(value);
+        return count + println();
+    }
+
+    size_t println(double value, int digits = 2)
+    {
+        size_t count = print(value, digits);
+        return count + println();
+    }
+};
+
+
+/// \brief The byte stream interface of the Arduino core.
+///
+/// Unlike the Arduino core, readBytes() does not wait for bytes to arrive.
+class Stream: public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(char* buffer, size_t size)
+    {
+        size_t count = 0;
+
+        while (count < size)
+        {
+            int data = read();
+
+            if (data < 0)
+                break;
+
+            buffer[count++] = static_cast<char>(data);
+        }
+
+        return count;
+    }
+
+    size_t readBytes(uint8_t* buffer, size_t size)
+    {
+        return readBytes(reinterpret_cast<char*>(buffer), size);
+    }
+
+    using Print::write;
+};
+
+
+/// \brief A Stream that writes to the standard output and never receives.
+///
+/// This stands in for the default `Serial` port of an Arduino core, so that
+/// sketches that only print results can run on a host.
+class HostSerial: public Stream
+{
+public:
+    void begin(unsigned long)
+    {
+    }
+
+    explicit operator bool() const
+    {
+        return true;
+    }
+
+    int available() override
+    {
+        return 0;
+    }
+
+    int read() override
+    {
+        return -1;
+    }
+
+    int peek() override
+    {
+        return -1;
+    }
+
+    size_t write(uint8_t data) override
+    {
+        return fputc(data, stdout) == EOF ? 0 : 1;
+    }
+
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        return fwrite(buffer, 1, size, stdout);
+    }
+
+    void flush() override
+    {
+        fflush(stdout);
+    }
+
+    using Stream::write;
+};
+
+
+static HostSerial Serial;
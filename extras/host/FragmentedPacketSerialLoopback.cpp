@@ -0,0 +1,267 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+// This program sends messages between two FragmentedPacketSerial endpoints
+// over an in-memory link that can drop chosen packets. It checks that the
+// message sink receives multi-fragment, single-fragment and zero-length
+// messages intact, that a lost first, middle or last fragment aborts the
+// message without affecting the next one, and that a sink that rejects a
+// message or one of its fragments stops receiving it. For each case it
+// prints whether the sink saw the expected calls.
+//
+// Build and run it from the root of the library with:
+//
+//     c++ -std=c++11 -O2 -I extras/host -I src -o fragments extras/host/FragmentedPacketSerialLoopback.cpp
+//     ./fragments
+
+#include <FragmentedPacketSerial.h>
+
+#include <stdio.h>
+#include <deque>
+#include <set>
+#include <vector>
+
+
+// The maximum number of message bytes in a fragment.
+const size_t FRAGMENT_SIZE = 64;
+
+typedef std::vector<uint8_t> Bytes;
+
+
+// One direction of a link that drops the packets whose index is in a set.
+// Packets are counted by their packet markers, from 0.
+class LossyStream: public Stream
+{
+public:
+    void drop(const std::set<size_t>& packets)
+    {
+        _drop = packets;
+    }
+
+    int available() override
+    {
+        return static_cast<int>(_bytes.size());
+    }
+
+    int read() override
+    {
+        if (_bytes.empty())
+            return -1;
+
+        uint8_t data = _bytes.front();
+        _bytes.pop_front();
+        return data;
+    }
+
+    int peek() override
+    {
+        return _bytes.empty() ? -1 : _bytes.front();
+    }
+
+    size_t write(uint8_t data) override
+    {
+        if (_drop.count(_packet) == 0)
+            _bytes.push_back(data);
+
+        if (data == 0)
+            _packet++;
+
+        return 1;
+    }
+
+    using Stream::write;
+
+private:
+    std::deque<uint8_t> _bytes;
+    std::set<size_t> _drop;
+    size_t _packet = 0;
+};
+
+
+// A message sink that records the calls it receives. It rejects messages
+// larger than maxSize, and fails a write once more than failAfter bytes of
+// a message have been written.
+struct RecordingSink
+{
+    bool begin(uint32_t size)
+    {
+        begins.push_back(size);
+        data.clear();
+        return size <= maxSize;
+    }
+
+    bool write(const uint8_t* buffer, size_t size)
+    {
+        if (data.size() + size > failAfter)
+            return false;
+
+        data.insert(data.end(), buffer, buffer + size);
+        return true;
+    }
+
+    void end(bool complete)
+    {
+        ends.push_back(complete);
+
+        if (complete)
+            messages.push_back(data);
+    }
+
+    void clear()
+    {
+        begins.clear();
+        ends.clear();
+        messages.clear();
+        data.clear();
+        maxSize = static_cast<uint32_t>(-1);
+        failAfter = static_cast<size_t>(-1);
+    }
+
+    std::vector<uint32_t> begins;
+    std::vector<bool> ends;
+    std::vector<Bytes> messages;
+    Bytes data;
+
+    uint32_t maxSize = static_cast<uint32_t>(-1);
+    size_t failAfter = static_cast<size_t>(-1);
+};
+
+
+typedef FragmentedPacketSerial_<RecordingSink, PacketSerial, FRAGMENT_SIZE> Endpoint;
+
+RecordingSink senderSink;
+RecordingSink receiverSink;
+
+
+Bytes makeMessage(size_t size, uint8_t seed)
+{
+    Bytes message(size);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        message[i] = static_cast<uint8_t>(seed + i * 13);
+    }
+
+    return message;
+}
+
+
+// Send messages from one endpoint to the other, dropping the given packets,
+// and return the receiving endpoint's dropped() count.
+uint32_t transfer(const std::vector<Bytes>& messages, const std::set<size_t>& drop)
+{
+    LossyStream stream;
+    stream.drop(drop);
+
+    Endpoint sender(senderSink);
+    sender.setStream(&stream);
+
+    Endpoint receiver(receiverSink);
+    receiver.setStream(&stream);
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        sender.send(messages[i].data(), messages[i].size());
+        receiver.update();
+    }
+
+    return receiver.dropped();
+}
+
+
+bool report(const char* name, bool ok)
+{
+    printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+
+int main()
+{
+    bool ok = true;
+
+    Bytes large = makeMessage(FRAGMENT_SIZE * 10 + 17, 1);
+    Bytes exact = makeMessage(FRAGMENT_SIZE * 2, 2);
+    Bytes small = makeMessage(FRAGMENT_SIZE / 2, 3);
+    Bytes empty;
+
+    {
+        receiverSink.clear();
+        std::vector<Bytes> messages = { large, exact, small, empty };
+        uint32_t dropped = transfer(messages, std::set<size_t>());
+
+        ok = report("Multi-fragment and small messages",
+                    receiverSink.messages == messages &&
+                    receiverSink.ends == std::vector<bool>(4, true) &&
+                    dropped == 0) && ok;
+    }
+
+    {
+        receiverSink.clear();
+        uint32_t dropped = transfer({ empty, empty }, std::set<size_t>());
+
+        ok = report("Zero-length messages",
+                    receiverSink.begins == std::vector<uint32_t>(2, 0) &&
+                    receiverSink.messages == std::vector<Bytes>(2, empty) &&
+                    dropped == 0) && ok;
+    }
+
+    // The large message is fragments 0 to 10, so small is fragment 11.
+    {
+        receiverSink.clear();
+        uint32_t dropped = transfer({ large, small }, { 4 });
+
+        ok = report("Lost middle fragment",
+                    receiverSink.ends == std::vector<bool>({ false, true }) &&
+                    receiverSink.messages == std::vector<Bytes>({ small }) &&
+                    dropped == 1) && ok;
+    }
+
+    {
+        receiverSink.clear();
+        uint32_t dropped = transfer({ large, small }, { 0 });
+
+        ok = report("Lost first fragment",
+                    receiverSink.begins == std::vector<uint32_t>({ static_cast<uint32_t>(small.size()) }) &&
+                    receiverSink.messages == std::vector<Bytes>({ small }) &&
+                    dropped == 0) && ok;
+    }
+
+    {
+        receiverSink.clear();
+        uint32_t dropped = transfer({ large, small }, { 10 });
+
+        ok = report("Lost last fragment",
+                    receiverSink.ends == std::vector<bool>({ false, true }) &&
+                    receiverSink.messages == std::vector<Bytes>({ small }) &&
+                    dropped == 1) && ok;
+    }
+
+    {
+        receiverSink.clear();
+        receiverSink.maxSize = static_cast<uint32_t>(large.size() - 1);
+        uint32_t dropped = transfer({ large, small }, std::set<size_t>());
+
+        ok = report("Sink rejects a message",
+                    receiverSink.begins.size() == 2 &&
+                    receiverSink.ends == std::vector<bool>({ true }) &&
+                    receiverSink.messages == std::vector<Bytes>({ small }) &&
+                    dropped == 0) && ok;
+    }
+
+    {
+        receiverSink.clear();
+        receiverSink.failAfter = FRAGMENT_SIZE * 3;
+        uint32_t dropped = transfer({ large, small }, std::set<size_t>());
+
+        ok = report("Sink rejects a fragment",
+                    receiverSink.ends == std::vector<bool>({ false, true }) &&
+                    receiverSink.messages == std::vector<Bytes>({ small }) &&
+                    dropped == 1) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+// This program runs the PacketSerialBenchmark example on a POSIX host and
+// prints its results to the standard output.
+//
+// Build and run it from the root of the library with:
+//
+//     c++ -std=c++11 -O2 -I extras/host -I src -o codec_benchmark extras/host/PacketSerialBenchmark.cpp
+//     ./codec_benchmark
+
+#include <Arduino.h>
+
+
+// The Arduino IDE declares the functions of a sketch before compiling it.
+void fillSensorReadings();
+void fill(size_t size, long rarity);
+bool verify(size_t iterations);
+void measure(const __FlashStringHelper* name, void (*function)());
+
+
+#include "../../examples/PacketSerialBenchmark/PacketSerialBenchmark.ino"
+
+
+int main()
+{
+    setup();
+    loop();
+    return 0;
+}
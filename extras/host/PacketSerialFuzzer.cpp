@@ -0,0 +1,391 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+// This program feeds arbitrary bytes to the COBS and SLIP decoders, the RLE
+// and LZ decompressors and the update() path of several PacketSerial_ types,
+// including ports that share a buffer pool. It aborts if a decoder reads or
+// writes out of bounds (with sanitizers), if the byte and run based decoders
+// disagree, if a decoded packet does not survive a round trip, if update()
+// does not consume its input in one pass, or if a pooled buffer is not
+// returned.
+//
+// With clang, build it as a libFuzzer target from the root of the library:
+//
+//     clang++ -std=c++11 -g -O1 -fsanitize=fuzzer,address,undefined -I extras/host -I src -o fuzzer extras/host/PacketSerialFuzzer.cpp
+//     ./fuzzer -max_len=1024
+//
+// Without libFuzzer, define PACKETSERIAL_FUZZ_STANDALONE to build a driver
+// that runs the files given on the command line, or pseudo-random inputs if
+// none are given:
+//
+//     c++ -std=c++11 -g -O1 -fsanitize=address,undefined -DPACKETSERIAL_FUZZ_STANDALONE -I extras/host -I src -o fuzzer extras/host/PacketSerialFuzzer.cpp
+//     ./fuzzer
+
+#include <PacketSerial.h>
+#include <CompressedPacketSerial.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define FUZZ_CHECK(condition)                                              \
+    do                                                                     \
+    {                                                                      \
+        if (!(condition))                                                  \
+        {                                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                   \
+                    __FILE__, __LINE__, #condition);                       \
+            abort();                                                       \
+        }                                                                  \
+    } while (false)
+
+
+// The largest input that is checked.
+const size_t MAX_INPUT_SIZE = 4096;
+
+
+// A Stream that reads from a buffer and discards written bytes.
+class MemoryStream: public Stream
+{
+public:
+    MemoryStream(const uint8_t* buffer, size_t size):
+        _buffer(buffer),
+        _size(size)
+    {
+    }
+
+    int available() override
+    {
+        return static_cast<int>(_size - _index);
+    }
+
+    int read() override
+    {
+        return _index < _size ? _buffer[_index++] : -1;
+    }
+
+    int peek() override
+    {
+        return _index < _size ? _buffer[_index] : -1;
+    }
+
+    size_t write(uint8_t) override
+    {
+        return 1;
+    }
+
+    using Stream::write;
+
+private:
+    const uint8_t* _buffer;
+    size_t _size;
+    size_t _index = 0;
+};
+
+
+// COBS without a StreamDecoder, so that PacketSerial_ buffers each packet and
+// decodes it with decode() when the packet marker arrives.
+struct BufferedCOBS
+{
+    static size_t encode(const uint8_t* buffer, size_t size, uint8_t* encodedBuffer)
+    {
+        return COBS::encode(buffer, size, encodedBuffer);
+    }
+
+    static size_t decode(const uint8_t* encodedBuffer, size_t size, uint8_t* decodedBuffer)
+    {
+        return COBS::decode(encodedBuffer, size, decodedBuffer);
+    }
+
+    static constexpr size_t getEncodedBufferSize(size_t size)
+    {
+        return COBS::getEncodedBufferSize(size);
+    }
+
+    static constexpr size_t getMaxDecodedSize(size_t size)
+    {
+        return COBS::getMaxDecodedSize(size);
+    }
+};
+
+
+size_t maxPacketSize = 0;
+size_t packetCount = 0;
+
+void onPacketReceived(const uint8_t* buffer, size_t size)
+{
+    FUZZ_CHECK(size <= maxPacketSize);
+    FUZZ_CHECK(size == 0 || buffer != nullptr);
+
+    // Touch every byte so that the sanitizers check the whole packet.
+    volatile uint8_t sum = 0;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        sum += buffer[i];
+    }
+
+    packetCount++;
+}
+
+
+// Check that the byte and run based decoders of an encoder agree, that they
+// stay within the input size and that a decoded packet survives a round trip.
+template<typename EncoderType>
+void checkDecoder(const uint8_t* data, size_t size)
+{
+    static uint8_t decodedBytes[MAX_INPUT_SIZE];
+    static uint8_t decodedRuns[MAX_INPUT_SIZE];
+    static uint8_t encoded[EncoderType::getEncodedBufferSize(MAX_INPUT_SIZE)];
+    static uint8_t roundTrip[EncoderType::getEncodedBufferSize(MAX_INPUT_SIZE)];
+
+    size_t numBytes = 0;
+    size_t numRuns = 0;
+
+    bool validBytes = EncoderType::tryDecodeBytes(data, size, decodedBytes, numBytes);
+    bool validRuns = EncoderType::tryDecodeRuns(data, size, decodedRuns, numRuns);
+
+    FUZZ_CHECK(validBytes == validRuns);
+    FUZZ_CHECK(numBytes == numRuns);
+    FUZZ_CHECK(numBytes <= size);
+    FUZZ_CHECK(memcmp(decodedBytes, decodedRuns, numBytes) == 0);
+    FUZZ_CHECK(validBytes || numBytes == 0);
+
+    if (validBytes && numBytes > 0)
+    {
+        size_t numEncoded = EncoderType::encode(decodedBytes, numBytes, encoded);
+        size_t numDecoded = 0;
+
+        FUZZ_CHECK(numEncoded <= EncoderType::getEncodedBufferSize(numBytes));
+        FUZZ_CHECK(EncoderType::tryDecode(encoded, numEncoded, roundTrip, numDecoded));
+        FUZZ_CHECK(numDecoded == numBytes);
+        FUZZ_CHECK(memcmp(roundTrip, decodedBytes, numBytes) == 0);
+    }
+
+    // Any input must also survive a round trip as a payload.
+    if (size > 0)
+    {
+        size_t numEncoded = EncoderType::encode(data, size, encoded);
+        size_t numDecoded = 0;
+
+        FUZZ_CHECK(numEncoded <= EncoderType::getEncodedBufferSize(size));
+        FUZZ_CHECK(EncoderType::tryDecode(encoded, numEncoded, roundTrip, numDecoded));
+        FUZZ_CHECK(numDecoded == size);
+        FUZZ_CHECK(memcmp(roundTrip, data, size) == 0);
+    }
+}
+
+
+// Check that a decompressor stays within its capacity and that a compressed
+// input survives a round trip.
+template<typename CompressionType>
+void checkCompression(const uint8_t* data, size_t size)
+{
+    static uint8_t decompressed[MAX_INPUT_SIZE];
+    static uint8_t compressed[MAX_INPUT_SIZE];
+
+    // Use a small capacity for some inputs to check the overflow checks.
+    size_t capacity = size > 0 && data[0] < 64 ? data[0] : MAX_INPUT_SIZE;
+
+    FUZZ_CHECK(CompressionType::decompress(data, size, decompressed, capacity) <= capacity);
+
+    size_t numCompressed = CompressionType::compress(data, size, compressed, sizeof(compressed));
+
+    if (numCompressed > 0)
+    {
+        size_t numDecompressed = CompressionType::decompress(compressed,
+                                                             numCompressed,
+                                                             decompressed,
+                                                             sizeof(decompressed));
+        FUZZ_CHECK(numDecompressed == size);
+        FUZZ_CHECK(memcmp(decompressed, data, size) == 0);
+    }
+}
+
+
+// Check that update() reads all available bytes in one call and never passes
+// a packet larger than its maximum packet size to the packet handler.
+template<typename EncoderType, uint8_t PacketMarker, size_t ReceiveBufferSize>
+void checkUpdate(const uint8_t* data, size_t size)
+{
+    MemoryStream stream(data, size);
+
+    PacketSerial_<EncoderType, PacketMarker, ReceiveBufferSize> packetSerial;
+    packetSerial.setStream(&stream);
+    packetSerial.setPacketHandler(&onPacketReceived);
+
+    // Check both ways of handling packets that overflow the receive buffer.
+    packetSerial.setResyncOnOverflow(size > 0 && (data[0] & 1));
+
+    maxPacketSize = EncoderTraits<EncoderType>::getMaxPacketSize(ReceiveBufferSize);
+    packetCount = 0;
+
+    FUZZ_CHECK(packetSerial.update(static_cast<size_t>(-1), static_cast<size_t>(-1)) == size);
+    FUZZ_CHECK(stream.available() == 0);
+
+    // At most one packet per packet marker.
+    FUZZ_CHECK(packetCount <= size);
+}
+
+
+// Check update() with buffers borrowed from a pool of one block that two
+// ports share, and that the block is returned when the ports are destroyed.
+template<typename EncoderType, uint8_t PacketMarker>
+void checkPooledUpdate(const uint8_t* data, size_t size)
+{
+    typedef PacketBufferPool_<128, 1> BufferPool;
+
+    BufferPool pool;
+
+    {
+        MemoryStream stream(data, size);
+        MemoryStream otherStream(data, size / 2);
+
+        PooledPacketSerial<BufferPool, EncoderType, PacketMarker> packetSerial;
+        packetSerial.setStream(&stream);
+        packetSerial.setBufferPool(&pool);
+        packetSerial.setPacketHandler(&onPacketReceived);
+
+        PooledPacketSerial<BufferPool, EncoderType, PacketMarker> otherPacketSerial;
+        otherPacketSerial.setStream(&otherStream);
+        otherPacketSerial.setBufferPool(&pool);
+        otherPacketSerial.setPacketHandler(&onPacketReceived);
+
+        maxPacketSize = EncoderTraits<EncoderType>::getMaxPacketSize(BufferPool::Size);
+
+        // Alternate between the ports so that they compete for the block.
+        while (stream.available() > 0 || otherStream.available() > 0)
+        {
+            packetSerial.update(16, static_cast<size_t>(-1));
+            otherPacketSerial.update(16, static_cast<size_t>(-1));
+        }
+
+        FUZZ_CHECK(pool.getAvailableBlocks() <= 1);
+    }
+
+    FUZZ_CHECK(pool.getAvailableBlocks() == 1);
+}
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size > MAX_INPUT_SIZE)
+        return 0;
+
+    checkDecoder<COBS>(data, size);
+    checkDecoder<SLIP>(data, size);
+
+    checkCompression<RLE>(data, size);
+    checkCompression<LZ>(data, size);
+
+    checkUpdate<COBS, 0, 256>(data, size);
+    checkUpdate<COBS, 0, 32>(data, size);
+    checkUpdate<SLIP, SLIP::END, 256>(data, size);
+    checkUpdate<CheckedEncoder<COBS, CRC16>, 0, 256>(data, size);
+    checkUpdate<CheckedEncoder<SLIP, CRC32>, SLIP::END, 256>(data, size);
+    checkUpdate<BufferedCOBS, 0, 64>(data, size);
+
+    checkPooledUpdate<COBS, 0>(data, size);
+    checkPooledUpdate<SLIP, SLIP::END>(data, size);
+
+    return 0;
+}
+
+
+#if defined(PACKETSERIAL_FUZZ_STANDALONE)
+
+// The number of pseudo-random inputs checked when no files are given.
+const size_t RANDOM_INPUT_COUNT = 100000;
+
+uint32_t randomState = 1;
+
+uint32_t nextRandom()
+{
+    // xorshift32
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+
+// Make an input that is likely to reach the interesting paths: random bytes
+// drawn mostly from the marker and escape bytes, or valid packets with a few
+// bytes changed.
+size_t makeInput(uint8_t* input)
+{
+    static const uint8_t special[] = { 0, 1, 0xFF, SLIP::END, SLIP::ESC, SLIP::ESC_END, SLIP::ESC_ESC };
+
+    uint8_t payload[MAX_INPUT_SIZE / 4];
+    size_t size = nextRandom() % sizeof(payload);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        uint32_t value = nextRandom();
+        payload[i] = (value & 0x300) ? special[value % sizeof(special)] : static_cast<uint8_t>(value);
+    }
+
+    switch (nextRandom() % 3)
+    {
+        case 0:
+            memcpy(input, payload, size);
+            break;
+        case 1:
+            size = COBS::encode(payload, size, input);
+            break;
+        default:
+            size = SLIP::encode(payload, size, input);
+            break;
+    }
+
+    size_t changes = size > 0 ? nextRandom() % 4 : 0;
+
+    for (size_t i = 0; i < changes; i++)
+    {
+        input[nextRandom() % size] = special[nextRandom() % sizeof(special)];
+    }
+
+    return size;
+}
+
+
+int main(int argc, char* argv[])
+{
+    static uint8_t input[MAX_INPUT_SIZE];
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            FILE* file = fopen(argv[i], "rb");
+
+            if (file == nullptr)
+            {
+                perror(argv[i]);
+                return 1;
+            }
+
+            size_t size = fread(input, 1, sizeof(input), file);
+            fclose(file);
+
+            LLVMFuzzerTestOneInput(input, size);
+        }
+
+        printf("Checked %d inputs.\n", argc - 1);
+        return 0;
+    }
+
+    for (size_t i = 0; i < RANDOM_INPUT_COUNT; i++)
+    {
+        size_t size = makeInput(input);
+        LLVMFuzzerTestOneInput(input, size);
+    }
+
+    printf("Checked %zu inputs.\n", RANDOM_INPUT_COUNT);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,193 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+// This program measures PacketSerial on a POSIX host. A writer thread sends
+// packets through a pseudo terminal or a pipe, paced to simulate a serial
+// link at a given baud rate, and the main thread receives and checks them
+// using FileDescriptorStream. For each rate it prints the throughput and the
+// share of one CPU core used by the receiving thread.
+//
+// Build and run it from the root of the library with:
+//
+//     c++ -std=c++11 -O2 -pthread -I extras/host -I src -o benchmark extras/host/PacketSerialHostBenchmark.cpp -lutil
+//     ./benchmark
+
+#include <PacketSerial.h>
+#include <Host/FileDescriptorStream.h>
+
+#include <stdio.h>
+#include <thread>
+
+#if defined(__APPLE__)
+    #include <util.h>
+#else
+    #include <pty.h>
+#endif
+
+
+// The number of bytes in each test packet.
+const size_t PACKET_SIZE = 256;
+
+// The number of packets sent for each measurement.
+const size_t PACKET_COUNT = 20000;
+
+typedef PacketSerial_<COBS, 0, PACKET_SIZE> BenchmarkPacketSerial;
+
+size_t packetsReceived = 0;
+size_t packetsCorrupted = 0;
+
+
+// Each packet is filled with its sequence number plus its byte index, and
+// every 16th byte is 0 so that COBS has something to encode.
+void fill(uint8_t* packet, size_t sequence)
+{
+    for (size_t i = 0; i < PACKET_SIZE; i++)
+    {
+        packet[i] = (i % 16 == 0) ? 0 : static_cast<uint8_t>(sequence + i);
+    }
+}
+
+
+void onPacketReceived(const uint8_t* buffer, size_t size)
+{
+    uint8_t expected[PACKET_SIZE];
+    fill(expected, packetsReceived);
+
+    if (size != PACKET_SIZE || memcmp(buffer, expected, PACKET_SIZE) != 0)
+        packetsCorrupted++;
+
+    packetsReceived++;
+}
+
+
+double seconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+double threadSeconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+// Send PACKET_COUNT packets, pacing them to the given baud rate with 10 bits
+// per byte. A baud rate of 0 sends as fast as possible, which measures the
+// maximum throughput of the receiving thread.
+void sendPackets(int fd, unsigned long baud)
+{
+    FileDescriptorStream stream(-1, fd);
+    BenchmarkPacketSerial packetSerial;
+    packetSerial.setStream(&stream);
+
+    uint8_t packet[PACKET_SIZE];
+    size_t bytesSent = 0;
+    double start = seconds();
+
+    for (size_t i = 0; i < PACKET_COUNT; i++)
+    {
+        fill(packet, i);
+        packetSerial.send(packet, PACKET_SIZE);
+        bytesSent += COBS::getEncodedBufferSize(PACKET_SIZE) + 1;
+
+        if (baud > 0)
+        {
+            stream.flush();
+
+            double due = start + bytesSent * 10.0 / baud;
+
+            while (seconds() < due)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    stream.flush();
+}
+
+
+void measure(const char* name, int readFd, int writeFd, unsigned long baud)
+{
+    FileDescriptorStream stream(readFd, -1);
+    BenchmarkPacketSerial packetSerial;
+    packetSerial.setStream(&stream);
+    packetSerial.setPacketHandler(&onPacketReceived);
+
+    packetsReceived = 0;
+    packetsCorrupted = 0;
+
+    double start = seconds();
+    double cpuStart = threadSeconds();
+
+    std::thread writer(sendPackets, writeFd, baud);
+
+    while (packetsReceived < PACKET_COUNT && stream.wait(1000))
+    {
+        packetSerial.update();
+    }
+
+    double elapsed = seconds() - start;
+    double cpu = threadSeconds() - cpuStart;
+
+    writer.join();
+
+    printf("%-12s %9lu baud: %8.2f MB/s, %5.1f%% CPU, %zu packets, %zu corrupted\n",
+           name,
+           baud,
+           packetsReceived * PACKET_SIZE / elapsed / 1e6,
+           100.0 * cpu / elapsed,
+           packetsReceived,
+           packetsCorrupted);
+}
+
+
+int main()
+{
+    const unsigned long rates[] = { 1000000, 4000000, 12000000, 0 };
+
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        int master = -1;
+        int slave = -1;
+
+        if (openpty(&master, &slave, nullptr, nullptr, nullptr) != 0)
+        {
+            perror("openpty");
+            return 1;
+        }
+
+        termios options;
+        tcgetattr(slave, &options);
+        cfmakeraw(&options);
+        tcsetattr(slave, TCSANOW, &options);
+
+        measure("pty", slave, master, rates[i]);
+
+        close(master);
+        close(slave);
+    }
+
+    int fds[2];
+
+    if (pipe(fds) != 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    measure("pipe", fds[0], fds[1], 0);
+
+    close(fds[0]);
+    close(fds[1]);
+
+    return 0;
+}
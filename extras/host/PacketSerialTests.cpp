@@ -0,0 +1,734 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+// This program checks the encoders and PacketSerial_ on a POSIX host. It
+// round trips packets through the COBS and SLIP buffer and stream encoders
+// and through PacketSerial_ over an in-memory link, checks the COBS block
+// boundaries at runs of 253, 254 and 255 non-zero bytes and SLIP input made
+// only of END bytes, checks that corrupt packets are dropped by buffered and
+// stream decoders alike, and checks what happens to packets that overflow the
+// receive buffer. It prints each failed check and exits with a non-zero
+// status if any check failed.
+//
+// Build and run it from the root of the library with:
+//
+//     c++ -std=c++11 -O1 -I extras/host -I src -o tests extras/host/PacketSerialTests.cpp
+//     ./tests
+
+#include <PacketSerial.h>
+#include <CompressedPacketSerial.h>
+#include <PacketRouter.h>
+
+#include <stdio.h>
+#include <deque>
+#include <type_traits>
+#include <vector>
+
+
+size_t checks = 0;
+size_t failures = 0;
+
+#define TEST_CHECK(condition)                                              \
+    do                                                                     \
+    {                                                                      \
+        checks++;                                                          \
+                                                                           \
+        if (!(condition))                                                  \
+        {                                                                  \
+            failures++;                                                    \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                   \
+                    __FILE__, __LINE__, #condition);                       \
+        }                                                                  \
+    } while (false)
+
+
+typedef std::vector<uint8_t> Bytes;
+
+
+// A Stream whose written bytes can be read back, i.e. both ends of a link.
+class LoopbackStream: public Stream
+{
+public:
+    int available() override
+    {
+        return static_cast<int>(_bytes.size());
+    }
+
+    int read() override
+    {
+        if (_bytes.empty())
+            return -1;
+
+        uint8_t data = _bytes.front();
+        _bytes.pop_front();
+        return data;
+    }
+
+    int peek() override
+    {
+        return _bytes.empty() ? -1 : _bytes.front();
+    }
+
+    size_t write(uint8_t data) override
+    {
+        _bytes.push_back(data);
+        return 1;
+    }
+
+    using Stream::write;
+
+private:
+    std::deque<uint8_t> _bytes;
+};
+
+
+// COBS without a StreamDecoder or StreamEncoder, so that PacketSerial_
+// buffers each packet and encodes and decodes it with the buffer functions.
+struct BufferedCOBS
+{
+    static size_t encode(const uint8_t* buffer, size_t size, uint8_t* encodedBuffer)
+    {
+        return COBS::encode(buffer, size, encodedBuffer);
+    }
+
+    static size_t decode(const uint8_t* encodedBuffer, size_t size, uint8_t* decodedBuffer)
+    {
+        return COBS::decode(encodedBuffer, size, decodedBuffer);
+    }
+
+    static bool tryDecode(const uint8_t* encodedBuffer,
+                          size_t size,
+                          uint8_t* decodedBuffer,
+                          size_t& numDecoded)
+    {
+        return COBS::tryDecode(encodedBuffer, size, decodedBuffer, numDecoded);
+    }
+
+    static constexpr size_t getEncodedBufferSize(size_t size)
+    {
+        return COBS::getEncodedBufferSize(size);
+    }
+
+    static constexpr size_t getMaxDecodedSize(size_t size)
+    {
+        return COBS::getMaxDecodedSize(size);
+    }
+};
+
+
+std::vector<Bytes> packets;
+
+void onPacketReceived(const uint8_t* buffer, size_t size)
+{
+    TEST_CHECK(buffer != nullptr);
+    packets.push_back(Bytes(buffer, buffer + size));
+}
+
+
+size_t overflows = 0;
+
+void onOverflow(const void*)
+{
+    overflows++;
+}
+
+
+// Make a packet of size bytes in which about one in every rarity bytes is
+// 0, SLIP::END or SLIP::ESC.
+Bytes makePacket(size_t size, long rarity)
+{
+    const uint8_t special[3] = { 0, SLIP::END, SLIP::ESC };
+
+    Bytes packet(size);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        packet[i] = random(rarity) == 0 ? special[random(3)] : 1 + random(255);
+    }
+
+    return packet;
+}
+
+
+// Encode a packet with the byte and run based encoders of an encoder, check
+// that they agree, and check that both decoders restore the packet.
+template<typename EncoderType>
+void checkBufferRoundTrip(const Bytes& packet)
+{
+    Bytes expected(EncoderType::getEncodedBufferSize(packet.size()));
+    Bytes actual(expected.size());
+
+    size_t expectedSize = EncoderType::encodeBytes(packet.data(), packet.size(), expected.data());
+    size_t actualSize = EncoderType::encodeRuns(packet.data(), packet.size(), actual.data());
+
+    TEST_CHECK(expectedSize <= expected.size());
+    TEST_CHECK(expectedSize == actualSize);
+    TEST_CHECK(memcmp(expected.data(), actual.data(), actualSize) == 0);
+
+    Bytes decoded(expectedSize + 1);
+
+    TEST_CHECK(EncoderType::decodeBytes(expected.data(), expectedSize, decoded.data()) == packet.size());
+    TEST_CHECK(memcmp(decoded.data(), packet.data(), packet.size()) == 0);
+
+    TEST_CHECK(EncoderType::decodeRuns(expected.data(), expectedSize, decoded.data()) == packet.size());
+    TEST_CHECK(memcmp(decoded.data(), packet.data(), packet.size()) == 0);
+}
+
+
+// Receive a corrupt packet between two valid ones, and check that it is
+// dropped.
+template<typename PacketSerialType>
+void checkCorruptPacket()
+{
+    LoopbackStream stream;
+    PacketSerialType packetSerial;
+    packetSerial.setStream(&stream);
+    packetSerial.setPacketHandler(&onPacketReceived);
+
+    Bytes first = makePacket(16, 4);
+    Bytes second = makePacket(16, 4);
+
+    packetSerial.send(first.data(), first.size());
+
+    // The code byte claims a block of 4 bytes, but only 1 follows.
+    const uint8_t corrupt[3] = { 0x05, 0x11, 0x00 };
+    stream.write(corrupt, sizeof(corrupt));
+
+    packetSerial.send(second.data(), second.size());
+
+    packets.clear();
+    packetSerial.update();
+
+    TEST_CHECK(packets.size() == 2);
+    TEST_CHECK(packets.size() == 2 && packets[0] == first && packets[1] == second);
+}
+
+
+// Send packets through a PacketSerial_ and check that the same instance
+// receives them unchanged.
+template<typename PacketSerialType>
+void checkPacketSerialRoundTrip(size_t maxSize)
+{
+    LoopbackStream stream;
+    PacketSerialType packetSerial;
+    packetSerial.setStream(&stream);
+    packetSerial.setPacketHandler(&onPacketReceived);
+
+    std::vector<Bytes> sent;
+
+    for (size_t size = 1; size <= maxSize; size += 1 + size / 8)
+    {
+        sent.push_back(makePacket(size, 1 + random(64)));
+        packetSerial.send(sent.back().data(), sent.back().size());
+    }
+
+    // The same packet again, as segments.
+    const Bytes& packet = sent.back();
+    const PacketSegment segments[3] = {
+        { packet.data(), 1 },
+        { packet.data() + 1, 0 },
+        { packet.data() + 1, packet.size() - 1 }
+    };
+
+    packetSerial.send(segments, 3);
+    sent.push_back(packet);
+
+    packets.clear();
+    packetSerial.update();
+
+    // SLIP sends a leading END, which the receiver sees as an empty packet.
+    std::vector<Bytes> received;
+
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        if (!packets[i].empty())
+            received.push_back(packets[i]);
+    }
+
+    TEST_CHECK(received == sent);
+    TEST_CHECK(!packetSerial.overflow());
+    TEST_CHECK(packetSerial.getOverflowCount() == 0);
+}
+
+
+void testBufferRoundTrips()
+{
+    for (size_t size = 1; size <= 1024; size += 1 + size / 16)
+    {
+        for (long rarity = 1; rarity <= 1024; rarity *= 4)
+        {
+            Bytes packet = makePacket(size, rarity);
+            checkBufferRoundTrip<COBS>(packet);
+            checkBufferRoundTrip<SLIP>(packet);
+        }
+    }
+}
+
+
+void testPacketSerialRoundTrips()
+{
+    checkPacketSerialRoundTrip<PacketSerial>(256);
+    checkPacketSerialRoundTrip<SLIPPacketSerial>(256);
+    checkPacketSerialRoundTrip<PacketSerial_<BufferedCOBS, 0, 512> >(256);
+    checkPacketSerialRoundTrip<PacketSerial_<CheckedEncoder<COBS, CRC32> > >(256);
+    checkPacketSerialRoundTrip<PacketSerial_<CheckedEncoder<SLIP, CRC16>, SLIP::END> >(256);
+    checkPacketSerialRoundTrip<PacketSerial_<COBS, 0, 256, 256, 1024> >(256);
+}
+
+
+// COBS writes a code byte before each run of at most 254 non-zero bytes. A
+// run of 254 bytes fills a block without consuming a zero, so 253, 254 and
+// 255 bytes are the sizes where the encoding changes.
+void testCOBSRunBoundaries()
+{
+    for (size_t run = 252; run <= 256; run++)
+    {
+        Bytes packet(run, 0x55);
+
+        Bytes encoded(COBS::getEncodedBufferSize(packet.size()));
+        size_t encodedSize = COBS::encode(packet.data(), packet.size(), encoded.data());
+
+        TEST_CHECK(encodedSize == COBS::getEncodedBufferSize(run));
+        TEST_CHECK(memchr(encoded.data(), 0, encodedSize) == nullptr);
+        TEST_CHECK(encoded[0] == (run < 254 ? run + 1 : 0xFF));
+
+        checkBufferRoundTrip<COBS>(packet);
+
+        // The run followed by a zero, and followed by a zero and more bytes.
+        packet.push_back(0);
+        checkBufferRoundTrip<COBS>(packet);
+        packet.push_back(0x55);
+        checkBufferRoundTrip<COBS>(packet);
+
+        // The run after a zero.
+        packet.assign(1, 0);
+        packet.insert(packet.end(), run, 0x55);
+        checkBufferRoundTrip<COBS>(packet);
+    }
+
+    // Runs that exactly fill the receive buffer of the stream and buffered
+    // decoders.
+    for (size_t run = 253; run <= 255; run++)
+    {
+        Bytes packet(run, 0x55);
+
+        LoopbackStream stream;
+        PacketSerial_<COBS, 0, 255> streamPacketSerial;
+        streamPacketSerial.setStream(&stream);
+        streamPacketSerial.setPacketHandler(&onPacketReceived);
+
+        packets.clear();
+        streamPacketSerial.send(packet.data(), packet.size());
+        streamPacketSerial.update();
+
+        TEST_CHECK(packets.size() == 1);
+        TEST_CHECK(packets.size() == 1 && packets[0] == packet);
+        TEST_CHECK(streamPacketSerial.getOverflowCount() == 0);
+
+        PacketSerial_<BufferedCOBS, 0, COBS::getEncodedBufferSize(255) + 1> bufferedPacketSerial;
+        bufferedPacketSerial.setStream(&stream);
+        bufferedPacketSerial.setPacketHandler(&onPacketReceived);
+
+        packets.clear();
+        bufferedPacketSerial.send(packet.data(), packet.size());
+        bufferedPacketSerial.update();
+
+        TEST_CHECK(packets.size() == 1);
+        TEST_CHECK(packets.size() == 1 && packets[0] == packet);
+        TEST_CHECK(bufferedPacketSerial.getOverflowCount() == 0);
+    }
+}
+
+
+void testSLIPAllEnd()
+{
+    // A packet of END bytes is escaped as ESC ESC_END pairs.
+    Bytes packet(64, SLIP::END);
+    Bytes encoded(SLIP::getEncodedBufferSize(packet.size()));
+    size_t encodedSize = SLIP::encode(packet.data(), packet.size(), encoded.data());
+
+    TEST_CHECK(encodedSize == 1 + 2 * packet.size());
+    TEST_CHECK(memchr(encoded.data() + 1, SLIP::END, encodedSize - 1) == nullptr);
+
+    checkBufferRoundTrip<SLIP>(packet);
+    checkBufferRoundTrip<SLIP>(Bytes(64, SLIP::ESC));
+
+    // Input made only of END bytes holds no data, so at most empty packets
+    // are received.
+    LoopbackStream stream;
+    SLIPPacketSerial packetSerial;
+    packetSerial.setStream(&stream);
+    packetSerial.setPacketHandler(&onPacketReceived);
+
+    for (size_t i = 0; i < 1000; i++)
+    {
+        stream.write(SLIP::END);
+    }
+
+    packets.clear();
+    packetSerial.update();
+
+    TEST_CHECK(stream.available() == 0);
+
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        TEST_CHECK(packets[i].empty());
+    }
+
+    // A packet of END bytes still gets through afterwards.
+    packetSerial.send(packet.data(), packet.size());
+    packets.clear();
+    packetSerial.update();
+
+    TEST_CHECK(!packets.empty() && packets.back() == packet);
+}
+
+
+void testCorruptPackets()
+{
+    // Buffered and stream decoders drop the same invalid input.
+    checkCorruptPacket<PacketSerial>();
+    checkCorruptPacket<PacketSerial_<BufferedCOBS, 0, 512> >();
+
+    static_assert(EncoderTraits<BufferedCOBS>::HasTryDecode,
+                  "BufferedCOBS must be decoded with tryDecode().");
+}
+
+
+// Send a packet that is too large for the receiver, then one that fits.
+template<typename PacketSerialType>
+void checkOverflow(bool resync)
+{
+    LoopbackStream stream;
+    PacketSerial_<COBS, 0, 256> sender;
+    sender.setStream(&stream);
+
+    PacketSerialType receiver;
+    receiver.setStream(&stream);
+    receiver.setPacketHandler(&onPacketReceived);
+    receiver.setOverflowHandler(&onOverflow);
+    receiver.setResyncOnOverflow(resync);
+
+    Bytes large = makePacket(100, 16);
+    Bytes small = makePacket(8, 16);
+
+    sender.send(large.data(), large.size());
+    sender.send(small.data(), small.size());
+
+    packets.clear();
+    overflows = 0;
+    receiver.update();
+
+    TEST_CHECK(overflows == 1);
+    TEST_CHECK(receiver.getOverflowCount() == 1);
+    TEST_CHECK(!receiver.overflow());
+
+    if (resync)
+    {
+        // The overflowed packet is dropped.
+        TEST_CHECK(packets.size() == 1);
+        TEST_CHECK(packets.size() == 1 && packets[0] == small);
+    }
+    else
+    {
+        // The overflowed packet is truncated but still delivered.
+        TEST_CHECK(packets.size() == 2);
+        TEST_CHECK(packets.size() == 2 && packets[1] == small);
+    }
+}
+
+
+void testOverflow()
+{
+    checkOverflow<PacketSerial_<COBS, 0, 32> >(false);
+    checkOverflow<PacketSerial_<COBS, 0, 32> >(true);
+    checkOverflow<PacketSerial_<BufferedCOBS, 0, 32> >(false);
+    checkOverflow<PacketSerial_<BufferedCOBS, 0, 32> >(true);
+
+    // The stream decoder stops at MaxPacketSize decoded bytes.
+    LoopbackStream stream;
+    PacketSerial_<COBS, 0, 32> packetSerial;
+    packetSerial.setStream(&stream);
+    packetSerial.setPacketHandler(&onPacketReceived);
+
+    Bytes packet(33, 0x55);
+    packetSerial.send(packet.data(), packet.size());
+
+    // The overflow flag is set until the packet marker arrives.
+    packets.clear();
+    packetSerial.update(packet.size() + 1, static_cast<size_t>(-1));
+
+    TEST_CHECK(packetSerial.overflow());
+    TEST_CHECK(packets.empty());
+
+    packetSerial.update();
+
+    TEST_CHECK(!packetSerial.overflow());
+    TEST_CHECK(packets.size() == 1);
+    TEST_CHECK(packets.size() == 1 && packets[0] == Bytes(32, 0x55));
+}
+
+
+// A packet handler that counts how often it is copied and moved.
+struct CountingHandler
+{
+    static size_t copies;
+    static size_t moves;
+
+    CountingHandler()
+    {
+    }
+
+    CountingHandler(const CountingHandler&)
+    {
+        copies++;
+    }
+
+    CountingHandler(CountingHandler&&)
+    {
+        moves++;
+    }
+
+    void operator () (const uint8_t* buffer, size_t size) const
+    {
+        onPacketReceived(buffer, size);
+    }
+};
+
+size_t CountingHandler::copies = 0;
+size_t CountingHandler::moves = 0;
+
+
+typedef InlinePacketSerial<CountingHandler> CountingPacketSerial;
+
+// A PacketSerial_ is not copyable, even from a non-const lvalue, which the
+// packet handler constructor would otherwise accept.
+static_assert(!std::is_constructible<CountingPacketSerial, CountingPacketSerial&>::value,
+              "PacketSerial_ must not be constructible from a PacketSerial_ lvalue.");
+static_assert(!std::is_constructible<CountingPacketSerial, const CountingPacketSerial&>::value,
+              "PacketSerial_ must not be copyable.");
+
+
+void testInlineHandlers()
+{
+    // An rvalue handler is moved into place, an lvalue handler is copied.
+    CountingHandler::copies = 0;
+    CountingHandler::moves = 0;
+
+    CountingPacketSerial movedPacketSerial((CountingHandler()));
+
+    TEST_CHECK(CountingHandler::copies == 0);
+    TEST_CHECK(CountingHandler::moves == 1);
+
+    CountingHandler handler;
+    CountingPacketSerial copiedPacketSerial(handler);
+
+    TEST_CHECK(CountingHandler::copies == 1);
+    TEST_CHECK(CountingHandler::moves == 1);
+
+    LoopbackStream stream;
+    copiedPacketSerial.setStream(&stream);
+
+    Bytes packet = makePacket(16, 4);
+    copiedPacketSerial.send(packet.data(), packet.size());
+
+    packets.clear();
+    copiedPacketSerial.update();
+
+    TEST_CHECK(packets.size() == 1 && packets[0] == packet);
+
+    // A capturing lambda.
+    size_t count = 0;
+    auto onPacket = [&count](const uint8_t*, size_t) { count++; };
+    InlinePacketSerial<decltype(onPacket)> lambdaPacketSerial(onPacket);
+
+    lambdaPacketSerial.setStream(&stream);
+    lambdaPacketSerial.send(packet.data(), packet.size());
+    lambdaPacketSerial.update();
+
+    TEST_CHECK(count == 1);
+}
+
+
+struct Position
+{
+    LittleEndian<int16_t> x;
+    LittleEndian<int16_t> y;
+};
+
+size_t pings = 0;
+Position lastPosition;
+
+void onPing(const uint8_t*, size_t)
+{
+    pings++;
+}
+
+void onPosition(const uint8_t* payload, size_t size)
+{
+    const Position* position = packetCast<Position>(payload, size);
+
+    TEST_CHECK(position != nullptr);
+
+    if (position)
+        lastPosition = *position;
+}
+
+
+void testRouter()
+{
+    PacketRouter router;
+
+    TEST_CHECK(router.setRoute(1, &onPing, 0, 0));
+    TEST_CHECK(router.setRoute(2, &onPosition, sizeof(Position), sizeof(Position)));
+
+    // The default table covers the ids 0 to 15.
+    TEST_CHECK(!router.setRoute(16, &onPing));
+
+    const uint8_t ping[1] = { 1 };
+    const uint8_t position[5] = { 2, 0x34, 0x12, 0xFE, 0xFF };
+    const uint8_t shortPosition[4] = { 2, 0x34, 0x12, 0xFE };
+    const uint8_t unrouted[1] = { 16 };
+
+    pings = 0;
+    router(ping, sizeof(ping));
+    router(position, sizeof(position));
+    router(shortPosition, sizeof(shortPosition));
+    router(unrouted, sizeof(unrouted));
+
+    TEST_CHECK(pings == 1);
+    TEST_CHECK(lastPosition.x == 0x1234);
+    TEST_CHECK(lastPosition.y == -2);
+    TEST_CHECK(router.dropped() == 2);
+}
+
+
+template<typename CompressionType>
+void checkCompressedRoundTrip()
+{
+    LoopbackStream stream;
+    CompressedPacketSerial<CompressionType> packetSerial;
+    packetSerial.setStream(&stream);
+    packetSerial.setPacketHandler(&onPacketReceived);
+
+    // The largest packet, which does not compress and is sent with its
+    // header byte, and one that compresses well.
+    Bytes random(255);
+
+    for (size_t i = 0; i < random.size(); i++)
+    {
+        random[i] = static_cast<uint8_t>(rand());
+    }
+
+    Bytes zeros(255, 0);
+
+    packetSerial.send(random.data(), random.size());
+    packetSerial.send(zeros.data(), zeros.size());
+
+    packets.clear();
+    packetSerial.update();
+
+    TEST_CHECK(packets.size() == 2);
+    TEST_CHECK(packets.size() == 2 && packets[0] == random && packets[1] == zeros);
+    TEST_CHECK(packetSerial.getPacketSerial().getOverflowCount() == 0);
+    TEST_CHECK(packetSerial.dropped() == 0);
+}
+
+
+void testCompression()
+{
+    checkCompressedRoundTrip<RLE>();
+    checkCompressedRoundTrip<LZ>();
+}
+
+
+template<typename PacketSerialType>
+void setBufferPool(PacketSerialType&, std::nullptr_t)
+{
+}
+
+
+template<typename PacketSerialType, typename BufferPoolType>
+void setBufferPool(PacketSerialType& packetSerial, BufferPoolType* pool)
+{
+    packetSerial.setBufferPool(pool);
+}
+
+
+// Empty packets reach the packet handler with a valid pointer, with and
+// without a buffer pool.
+template<typename PacketSerialType, typename BufferPoolPointer>
+void checkEmptyPackets(uint8_t packetMarker, BufferPoolPointer pool)
+{
+    LoopbackStream stream;
+    PacketSerialType packetSerial;
+    packetSerial.setStream(&stream);
+    packetSerial.setPacketHandler(&onPacketReceived);
+    setBufferPool(packetSerial, pool);
+
+    Bytes packet = makePacket(16, 4);
+
+    stream.write(packetMarker);
+    stream.write(packetMarker);
+    packetSerial.send(packet.data(), packet.size());
+    stream.write(packetMarker);
+
+    // onPacketReceived() checks the pointer of each packet.
+    packets.clear();
+    packetSerial.update();
+
+    TEST_CHECK(!packets.empty());
+
+    size_t nonEmpty = 0;
+
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        if (!packets[i].empty())
+        {
+            nonEmpty++;
+            TEST_CHECK(packets[i] == packet);
+        }
+    }
+
+    TEST_CHECK(nonEmpty == 1);
+}
+
+
+void testPooledEmptyPackets()
+{
+    // Encoders without a StreamDecoder borrow a second block to decode into.
+    typedef PacketBufferPool_<256, 2> Pool;
+    Pool pool;
+
+    checkEmptyPackets<PacketSerial>(0, nullptr);
+    checkEmptyPackets<SLIPPacketSerial>(SLIP::END, nullptr);
+    checkEmptyPackets<PooledPacketSerial<Pool> >(0, &pool);
+    checkEmptyPackets<PooledPacketSerial<Pool, SLIP, SLIP::END> >(SLIP::END, &pool);
+    checkEmptyPackets<PooledPacketSerial<Pool, BufferedCOBS, 0, 128> >(0, &pool);
+
+    TEST_CHECK(pool.getAvailableBlocks() == Pool::Count);
+}
+
+
+int main()
+{
+    randomSeed(1);
+
+    testBufferRoundTrips();
+    testPacketSerialRoundTrips();
+    testCOBSRunBoundaries();
+    testSLIPAllEnd();
+    testCorruptPackets();
+    testOverflow();
+    testInlineHandlers();
+    testRouter();
+    testCompression();
+    testPooledEmptyPackets();
+
+    printf("%zu checks, %zu failed\n", checks, failures);
+
+    return failures == 0 ? 0 : 1;
+}
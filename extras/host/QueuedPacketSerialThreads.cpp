@@ -0,0 +1,167 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+// This program feeds a QueuedPacketSerial from a producer thread, which
+// stands in for a UART interrupt or a DMA callback, while the main thread
+// consumes the queued packets. The producer passes encoded numbered packets
+// to receive() in blocks of random size, including some packets that are
+// too large for a slot. The consumer checks that every packet it receives
+// is intact and newer than the previous one, and that each packet sent was
+// either received or counted by dropped().
+//
+// Build it with the thread sanitizer to check the queue for data races:
+//
+//     c++ -std=c++11 -g -O1 -pthread -fsanitize=thread -I extras/host -I src -o threads extras/host/QueuedPacketSerialThreads.cpp
+//     ./threads
+
+#include <QueuedPacketSerial.h>
+
+#include <stdio.h>
+#include <atomic>
+#include <random>
+#include <thread>
+
+
+// The number of packets sent by the producer.
+const uint32_t PACKET_COUNT = 200000;
+
+// The number of slots in the queue.
+const uint8_t SLOT_COUNT = 4;
+
+// The number of decoded bytes in each slot of the queue.
+const size_t SLOT_SIZE = 32;
+
+typedef QueuedPacketSerial_<COBS, 0, SLOT_COUNT, SLOT_SIZE> ThreadedPacketSerial;
+
+ThreadedPacketSerial packetSerial;
+std::atomic<bool> producerDone(false);
+
+
+// Each packet starts with its sequence number, followed by bytes derived
+// from it. Every fourth byte is 0 so that COBS has something to encode.
+size_t fill(uint8_t* packet, uint32_t sequence, size_t size)
+{
+    memcpy(packet, &sequence, sizeof(sequence));
+
+    for (size_t i = sizeof(sequence); i < size; i++)
+    {
+        packet[i] = (i % 4 == 0) ? 0 : static_cast<uint8_t>(sequence * 7 + i);
+    }
+
+    return size;
+}
+
+
+void produce()
+{
+    std::mt19937 randomEngine(1);
+
+    // Mostly packets that fit a slot, and some that are too large.
+    std::uniform_int_distribution<size_t> randomSize(sizeof(uint32_t), SLOT_SIZE + 8);
+    std::uniform_int_distribution<size_t> randomBlock(1, 64);
+
+    uint8_t packet[SLOT_SIZE + 8];
+    uint8_t encoded[COBS::getEncodedBufferSize(SLOT_SIZE + 8) + 1];
+
+    for (uint32_t sequence = 0; sequence < PACKET_COUNT; sequence++)
+    {
+        // Let the consumer catch up before every other packet, so that
+        // packets are dropped both because the queue is full and because
+        // they are too large.
+        while (sequence % 2 == 0 && packetSerial.available() == SLOT_COUNT)
+        {
+            std::this_thread::yield();
+        }
+
+        size_t size = fill(packet, sequence, randomSize(randomEngine));
+        size_t encodedSize = COBS::encode(packet, size, encoded);
+        encoded[encodedSize++] = 0;
+
+        for (size_t offset = 0; offset < encodedSize;)
+        {
+            size_t block = randomBlock(randomEngine);
+
+            if (block > encodedSize - offset)
+                block = encodedSize - offset;
+
+            packetSerial.receive(encoded + offset, block);
+            offset += block;
+        }
+    }
+
+    producerDone = true;
+}
+
+
+int main()
+{
+    std::thread producer(produce);
+
+    uint32_t received = 0;
+    uint32_t next = 0;
+    size_t dropped = 0;
+    bool ok = true;
+
+    while (true)
+    {
+        // Read the flag first, so that no packet can be queued after the
+        // queue is found empty.
+        bool done = producerDone;
+
+        const uint8_t* buffer;
+        size_t size;
+
+        if (!packetSerial.peek(buffer, size))
+        {
+            if (done)
+                break;
+
+            std::this_thread::yield();
+            continue;
+        }
+
+        uint32_t sequence = 0;
+        uint8_t expected[SLOT_SIZE];
+
+        if (size >= sizeof(sequence))
+            memcpy(&sequence, buffer, sizeof(sequence));
+
+        if (size < sizeof(sequence) ||
+            size > SLOT_SIZE ||
+            sequence < next ||
+            memcmp(buffer, expected, fill(expected, sequence, size)) != 0)
+        {
+            ok = false;
+        }
+
+        next = sequence + 1;
+        received++;
+        packetSerial.release();
+
+        // The counter only grows.
+        size_t count = packetSerial.dropped();
+
+        if (count < dropped)
+            ok = false;
+
+        dropped = count;
+    }
+
+    producer.join();
+
+    dropped = packetSerial.dropped();
+
+    if (received + dropped != PACKET_COUNT)
+        ok = false;
+
+    printf("%u packets sent, %u received, %zu dropped: %s\n",
+           PACKET_COUNT,
+           received,
+           dropped,
+           ok ? "ok" : "FAILED");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+// This program runs two ReliablePacketSerial endpoints over a simulated
+// serial link in memory. The link delivers bytes at a given baud rate after a
+// fixed latency, and drops or corrupts random bytes. Both endpoints send
+// numbered packets as fast as their send window allows, then stop sending
+// and keep updating until every packet has been acknowledged. Each endpoint
+// checks that it received every packet of the other exactly once and in
+// order. For each window size it prints the goodput, i.e. the payload bytes
+// delivered per second in one direction, and the number of retransmissions.
+//
+// Build and run it from the root of the library with:
+//
+//     c++ -std=c++11 -O2 -I extras/host -I src -o loopback extras/host/ReliablePacketSerialLoopback.cpp
+//     ./loopback
+
+#include <ReliablePacketSerial.h>
+
+#include <stdio.h>
+#include <deque>
+#include <random>
+
+
+// The simulated baud rate, with 10 bits per byte.
+const unsigned long BAUD = 115200;
+
+// The time each byte takes to cross the link.
+const unsigned long LATENCY_MICROS = 5000;
+
+// The probability that a byte is dropped, and that a byte is corrupted.
+const double LOSS_RATE = 0.0002;
+const double CORRUPTION_RATE = 0.0002;
+
+// The duration of each measurement in microseconds.
+const unsigned long DURATION_MICROS = 2000000;
+
+// The longest time to wait for the send windows to empty after the
+// measurement, in microseconds.
+const unsigned long DRAIN_TIMEOUT_MICROS = 10000000;
+
+// The number of payload bytes in each packet.
+const size_t PAYLOAD_SIZE = 64;
+
+std::mt19937 randomEngine(1);
+std::uniform_real_distribution<double> randomRate(0.0, 1.0);
+
+
+// One direction of the simulated link.
+class Link
+{
+public:
+    void write(uint8_t data)
+    {
+        unsigned long now = micros();
+
+        // Bytes are sent one after the other at the baud rate.
+        if (static_cast<long>(now - _sendMicros) > 0)
+            _sendMicros = now;
+
+        _sendMicros += 10000000UL / BAUD;
+
+        double chance = randomRate(randomEngine);
+
+        if (chance < LOSS_RATE)
+            return;
+
+        if (chance < LOSS_RATE + CORRUPTION_RATE)
+            data ^= static_cast<uint8_t>(1 << (randomEngine() % 8));
+
+        Byte byte = { _sendMicros + LATENCY_MICROS, data };
+        _bytes.push_back(byte);
+    }
+
+    int available() const
+    {
+        unsigned long now = micros();
+        int count = 0;
+
+        for (size_t i = 0; i < _bytes.size(); i++)
+        {
+            if (static_cast<long>(now - _bytes[i].arrivalMicros) < 0)
+                break;
+
+            count++;
+        }
+
+        return count;
+    }
+
+    int read()
+    {
+        if (available() == 0)
+            return -1;
+
+        uint8_t data = _bytes.front().data;
+        _bytes.pop_front();
+        return data;
+    }
+
+    int peek() const
+    {
+        return available() > 0 ? _bytes.front().data : -1;
+    }
+
+private:
+    struct Byte
+    {
+        unsigned long arrivalMicros;
+        uint8_t data;
+    };
+
+    std::deque<Byte> _bytes;
+    unsigned long _sendMicros = 0;
+};
+
+
+// One end of the simulated link.
+class LinkStream: public Stream
+{
+public:
+    LinkStream(Link& input, Link& output):
+        _input(input),
+        _output(output)
+    {
+    }
+
+    int available() override
+    {
+        return _input.available();
+    }
+
+    int read() override
+    {
+        return _input.read();
+    }
+
+    int peek() override
+    {
+        return _input.peek();
+    }
+
+    size_t write(uint8_t data) override
+    {
+        _output.write(data);
+        return 1;
+    }
+
+    using Stream::write;
+
+private:
+    Link& _input;
+    Link& _output;
+};
+
+
+// The sequence number of the next packet each endpoint expects, and whether
+// any packet arrived out of order.
+uint32_t expected[2] = { 0, 0 };
+bool outOfOrder = false;
+
+template<size_t Endpoint>
+void onPacketReceived(const uint8_t* buffer, size_t size)
+{
+    uint32_t sequence = 0;
+
+    if (size == PAYLOAD_SIZE)
+        memcpy(&sequence, buffer, sizeof(sequence));
+
+    if (size != PAYLOAD_SIZE || sequence != expected[Endpoint])
+        outOfOrder = true;
+
+    expected[Endpoint]++;
+}
+
+
+template<size_t WindowSize>
+bool measure()
+{
+    typedef ReliablePacketSerial_<PacketSerial_<CheckedEncoder<COBS, CRC16> >,
+                                  WindowSize,
+                                  PAYLOAD_SIZE> Endpoint;
+
+    Link forward;
+    Link backward;
+    LinkStream streamA(backward, forward);
+    LinkStream streamB(forward, backward);
+
+    Endpoint endpointA;
+    endpointA.setStream(&streamA);
+    endpointA.setPacketHandler(&onPacketReceived<0>);
+
+    Endpoint endpointB;
+    endpointB.setStream(&streamB);
+    endpointB.setPacketHandler(&onPacketReceived<1>);
+
+    // Long enough for a full window of packets to be queued ahead of an
+    // acknowledgement at 115200 baud.
+    endpointA.setRetransmitTimeout(200000);
+    endpointB.setRetransmitTimeout(200000);
+
+    expected[0] = 0;
+    expected[1] = 0;
+    outOfOrder = false;
+
+    uint32_t sent[2] = { 0, 0 };
+    uint8_t payload[PAYLOAD_SIZE] = { };
+
+    unsigned long start = micros();
+
+    while (micros() - start < DURATION_MICROS)
+    {
+        memcpy(payload, &sent[0], sizeof(sent[0]));
+
+        if (endpointA.send(payload, PAYLOAD_SIZE))
+            sent[0]++;
+
+        memcpy(payload, &sent[1], sizeof(sent[1]));
+
+        if (endpointB.send(payload, PAYLOAD_SIZE))
+            sent[1]++;
+
+        endpointA.update();
+        endpointB.update();
+    }
+
+    uint32_t delivered = expected[1];
+
+    // Deliver the packets that are still in flight.
+    start = micros();
+
+    while ((endpointA.getUnacknowledgedCount() > 0 ||
+            endpointB.getUnacknowledgedCount() > 0) &&
+           micros() - start < DRAIN_TIMEOUT_MICROS)
+    {
+        endpointA.update();
+        endpointB.update();
+    }
+
+    // Each endpoint must have received every packet sent by the other.
+    bool ok = !outOfOrder &&
+              sent[0] > 0 &&
+              sent[1] > 0 &&
+              expected[1] == sent[0] &&
+              expected[0] == sent[1];
+
+    double seconds = DURATION_MICROS / 1000000.0;
+
+    printf("%6zu %16.0f %9.1f%% %15u %10s\n",
+           WindowSize,
+           delivered * PAYLOAD_SIZE / seconds,
+           100.0 * delivered * PAYLOAD_SIZE / seconds / (BAUD / 10),
+           endpointA.retransmitted() + endpointB.retransmitted(),
+           ok ? "ok" : "FAILED");
+
+    return ok;
+}
+
+
+int main()
+{
+    printf("%.2f%% byte loss, %.2f%% byte corruption, %lu baud, %lu ms latency\n",
+           LOSS_RATE * 100,
+           CORRUPTION_RATE * 100,
+           BAUD,
+           LATENCY_MICROS / 1000);
+    printf("%6s %16s %10s %15s %10s\n", "Window", "Goodput (B/s)", "Link use", "Retransmitted", "Delivered");
+
+    bool ok = measure<1>();
+    ok = measure<2>() && ok;
+    ok = measure<4>() && ok;
+    ok = measure<8>() && ok;
+    ok = measure<16>() && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "PacketSerial.h"
+#include "Encoding/LZ.h"
+#include "Encoding/RLE.h"
+
+
+/// \brief A PacketSerial_ that compresses packets before they are encoded.
+///
+/// Each packet starts with a header byte. If bit 0 of the header is set, the
+/// rest of the packet is compressed. Otherwise it is sent as is, so packets
+/// that do not compress cost only the header byte:
+///
+///     CompressedPacketSerial<RLE> myPacketSerial;
+///
+///     void setup()
+///     {
+///         myPacketSerial.begin(9600);
+///         myPacketSerial.setPacketHandler(&onPacketReceived);
+///     }
+///
+///     void loop()
+///     {
+///         myPacketSerial.update();
+///     }
+///
+/// The packet handler receives decompressed packets. Packets that fail to
+/// decompress, or whose header has unknown bits set, are dropped and counted
+/// by `dropped()`.
+///
+/// Both ends of a link must use the same compressor. Because the header says
+/// whether each packet is compressed, a receiver can always read packets from
+/// a sender that does not compress, e.g. a host that sends a header of 0.
+///
+/// A packet is compressed into a send buffer and decompressed into a receive
+/// buffer, each of `MaxPacketSize` bytes, so packet handlers may send packets.
+///
+/// \tparam CompressionType The compressor, e.g. `RLE` or `LZ`.
+/// \tparam PacketSerialType The PacketSerial_ type that sends the packets.
+///         It must accept packets of `MaxPacketSize + 1` bytes, because a
+///         packet that does not compress is sent with its header byte.
+/// \tparam MaxPacketSize The maximum number of bytes in a packet before it
+///         is compressed. The default fits the default PacketSerial.
+template<typename CompressionType,
+         typename PacketSerialType = PacketSerial,
+         size_t MaxPacketSize = 255>
+class CompressedPacketSerial_
+{
+public:
+    static_assert(MaxPacketSize + 1 <= PacketSerialType::MaxDecodedSize,
+                  "PacketSerialType must accept packets of MaxPacketSize + 1 bytes.");
+
+    /// \brief A typedef describing the packet handler method.
+    /// \sa PacketSerial_::PacketHandlerFunction
+    typedef void (*PacketHandlerFunction)(const uint8_t* buffer, size_t size);
+
+    enum
+    {
+        /// \brief The header bit set for compressed packets.
+        Compressed = 0x01
+    };
+
+    /// \brief Construct a CompressedPacketSerial_ without a stream.
+    CompressedPacketSerial_()
+    {
+        _packetSerial.setPacketHandler(&onPacketReceived, this);
+    }
+
+#if defined(ARDUINO)
+    /// \brief Begin a default serial connection with the given speed.
+    /// \param speed The serial data transmission speed in bits / second (baud).
+    /// \sa PacketSerial_::begin()
+    void begin(unsigned long speed)
+    {
+        _packetSerial.begin(speed);
+    }
+#endif
+
+    /// \brief Attach to an existing Arduino `Stream`.
+    /// \param stream A pointer to an Arduino `Stream`.
+    void setStream(Stream* stream)
+    {
+        _packetSerial.setStream(stream);
+    }
+
+    /// \brief Get the PacketSerial_ that sends the compressed packets.
+    ///
+    /// Its packet handler is used to decompress packets and must not be
+    /// changed.
+    ///
+    /// \returns the PacketSerial_ instance.
+    PacketSerialType& getPacketSerial()
+    {
+        return _packetSerial;
+    }
+
+    /// \brief Set the function that will receive decompressed packets.
+    /// \param onPacketFunction A pointer to the packet handler function.
+    void setPacketHandler(PacketHandlerFunction onPacketFunction)
+    {
+        _onPacketFunction = onPacketFunction;
+    }
+
+    /// \brief Service the serial connection.
+    /// \sa PacketSerial_::update()
+    void update()
+    {
+        _packetSerial.update();
+    }
+
+    /// \brief Compress and send a packet.
+    ///
+    /// Packets larger than `MaxPacketSize` are not sent.
+    ///
+    /// \param buffer A pointer to a data buffer.
+    /// \param size The number of bytes in the data buffer.
+    void send(const uint8_t* buffer, size_t size)
+    {
+        if (buffer == nullptr || size == 0 || size > MaxPacketSize) return;
+
+        // Compressed packets must be smaller than the packet itself.
+        size_t numCompressed = CompressionType::compress(buffer,
+                                                         size,
+                                                         _sendBuffer + 1,
+                                                         size - 1);
+
+        if (numCompressed > 0)
+        {
+            _sendBuffer[0] = Compressed;
+            _packetSerial.send(_sendBuffer, numCompressed + 1);
+        }
+        else
+        {
+            const uint8_t header = 0;
+
+            const PacketSegment segments[2] = {
+                { &header, 1 },
+                { buffer, size }
+            };
+
+            _packetSerial.send(segments, 2);
+        }
+    }
+
+    /// \returns the number of received packets that failed to decompress.
+    uint32_t dropped() const
+    {
+        return _dropped;
+    }
+
+private:
+    CompressedPacketSerial_(const CompressedPacketSerial_&);
+    CompressedPacketSerial_& operator = (const CompressedPacketSerial_&);
+
+    static void onPacketReceived(const void* sender, const uint8_t* buffer, size_t size)
+    {
+        static_cast<CompressedPacketSerial_*>(const_cast<void*>(sender))->receive(buffer, size);
+    }
+
+    void receive(const uint8_t* buffer, size_t size)
+    {
+        if (size == 0 || _onPacketFunction == nullptr)
+            return;
+
+        uint8_t header = buffer[0];
+
+        if (header == 0)
+        {
+            _onPacketFunction(buffer + 1, size - 1);
+            return;
+        }
+
+        size_t numDecompressed = 0;
+
+        if (header == Compressed)
+        {
+            numDecompressed = CompressionType::decompress(buffer + 1,
+                                                          size - 1,
+                                                          _receiveBuffer,
+                                                          MaxPacketSize);
+        }
+
+        if (numDecompressed == 0)
+        {
+            _dropped++;
+            return;
+        }
+
+        _onPacketFunction(_receiveBuffer, numDecompressed);
+    }
+
+    PacketSerialType _packetSerial;
+
+    PacketHandlerFunction _onPacketFunction = nullptr;
+
+    uint8_t _sendBuffer[MaxPacketSize];
+    uint8_t _receiveBuffer[MaxPacketSize];
+
+    uint32_t _dropped = 0;
+};
+
+
+/// \brief A CompressedPacketSerial_ over a default COBS PacketSerial.
+template<typename CompressionType>
+using CompressedPacketSerial = CompressedPacketSerial_<CompressionType>;
@@ -0,0 +1,167 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "Arduino.h"
+
+
+/// \brief Set to 1 to search for bytes a word at a time.
+///
+/// Word-at-a-time search is enabled by default on all platforms except AVR,
+/// where the byte-at-a-time loop is faster. It can be disabled by defining
+/// `PACKETSERIAL_USE_WORD_SEARCH` as 0 before including PacketSerial.h.
+#ifndef PACKETSERIAL_USE_WORD_SEARCH
+    #if defined(__AVR__)
+        #define PACKETSERIAL_USE_WORD_SEARCH 0
+    #else
+        #define PACKETSERIAL_USE_WORD_SEARCH 1
+    #endif
+#endif
+
+
+#if PACKETSERIAL_USE_WORD_SEARCH && defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+
+/// \brief Byte search kernels used by the packet encoders.
+///
+/// When `PACKETSERIAL_USE_WORD_SEARCH` is enabled the buffer is scanned 16
+/// bytes at a time with SSE2 if available, otherwise a machine word at a time
+/// using the "has zero byte" bit trick. Otherwise the buffer is scanned one
+/// byte at a time.
+///
+/// \sa https://graphics.stanford.edu/~seander/bithacks.html#ZeroInWord
+class ByteSearch
+{
+public:
+    /// \brief Find the first occurrence of a byte value.
+    /// \param buffer A pointer to the buffer to search.
+    /// \param size The number of bytes in the \p buffer.
+    /// \param value The byte value to find.
+    /// \returns the index of the first occurrence of \p value, or \p size if
+    ///          \p value was not found.
+    static size_t find(const uint8_t* buffer, size_t size, uint8_t value)
+    {
+        size_t index = 0;
+
+#if PACKETSERIAL_USE_WORD_SEARCH
+    #if defined(__SSE2__)
+        const __m128i blockPattern = _mm_set1_epi8(static_cast<char>(value));
+
+        while (index + 16 <= size)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + index));
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, blockPattern));
+
+            if (mask != 0)
+                return index + __builtin_ctz(mask);
+
+            index += 16;
+        }
+    #endif
+        const Word wordPattern = broadcast(value);
+
+        while (index + sizeof(Word) <= size)
+        {
+            if (hasZero(load(buffer + index) ^ wordPattern))
+                break;
+
+            index += sizeof(Word);
+        }
+#endif
+
+        while (index < size && buffer[index] != value)
+        {
+            index++;
+        }
+
+        return index;
+    }
+
+    /// \brief Find the first occurrence of either of two byte values.
+    /// \param buffer A pointer to the buffer to search.
+    /// \param size The number of bytes in the \p buffer.
+    /// \param value0 The first byte value to find.
+    /// \param value1 The second byte value to find.
+    /// \returns the index of the first occurrence of \p value0 or \p value1,
+    ///          or \p size if neither was found.
+    static size_t findEither(const uint8_t* buffer,
+                             size_t size,
+                             uint8_t value0,
+                             uint8_t value1)
+    {
+        size_t index = 0;
+
+#if PACKETSERIAL_USE_WORD_SEARCH
+    #if defined(__SSE2__)
+        const __m128i blockPattern0 = _mm_set1_epi8(static_cast<char>(value0));
+        const __m128i blockPattern1 = _mm_set1_epi8(static_cast<char>(value1));
+
+        while (index + 16 <= size)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + index));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, blockPattern0),
+                                                      _mm_cmpeq_epi8(block, blockPattern1)));
+
+            if (mask != 0)
+                return index + __builtin_ctz(mask);
+
+            index += 16;
+        }
+    #endif
+        const Word wordPattern0 = broadcast(value0);
+        const Word wordPattern1 = broadcast(value1);
+
+        while (index + sizeof(Word) <= size)
+        {
+            Word word = load(buffer + index);
+
+            if (hasZero(word ^ wordPattern0) || hasZero(word ^ wordPattern1))
+                break;
+
+            index += sizeof(Word);
+        }
+#endif
+
+        while (index < size
+            && buffer[index] != value0
+            && buffer[index] != value1)
+        {
+            index++;
+        }
+
+        return index;
+    }
+
+private:
+    /// \brief The widest integer that is cheap to load on this platform.
+    typedef uintptr_t Word;
+
+    static Word broadcast(uint8_t value)
+    {
+        return (~static_cast<Word>(0) / 0xFF) * value;
+    }
+
+    static Word load(const uint8_t* buffer)
+    {
+        // memcpy compiles to a single (possibly unaligned) load.
+        Word word;
+        memcpy(&word, buffer, sizeof(Word));
+        return word;
+    }
+
+    static bool hasZero(Word word)
+    {
+        const Word ones  = ~static_cast<Word>(0) / 0xFF;
+        const Word highs = ones * 0x80;
+        return ((word - ones) & ~word & highs) != 0;
+    }
+
+};
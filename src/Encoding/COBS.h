@@ -10,6 +10,8 @@
 
 
 #include "Arduino.h"
+#include "ByteSearch.h"
+#include "PacketSegment.h"
 
 
 /// \brief A Consistent Overhead Byte Stuffing (COBS) Encoder.
@@ -41,6 +43,26 @@ public:
                          size_t size,
                          uint8_t* encodedBuffer)
     {
+#if PACKETSERIAL_USE_WORD_SEARCH
+        return encodeRuns(buffer, size, encodedBuffer);
+#else
+        return encodeBytes(buffer, size, encodedBuffer);
+#endif
+    }
+
+    /// \brief Encode a byte buffer one byte at a time.
+    ///
+    /// This is the reference implementation used on platforms where
+    /// `PACKETSERIAL_USE_WORD_SEARCH` is disabled.
+    ///
+    /// \param buffer A pointer to the unencoded buffer to encode.
+    /// \param size  The number of bytes in the \p buffer.
+    /// \param encodedBuffer The buffer for the encoded bytes.
+    /// \returns The number of bytes written to the \p encodedBuffer.
+    static size_t encodeBytes(const uint8_t* buffer,
+                              size_t size,
+                              uint8_t* encodedBuffer)
+    {
         size_t read_index  = 0;
         size_t write_index = 1;
         size_t code_index  = 0;
@@ -74,32 +96,151 @@ public:
         return write_index;
     }
 
+    /// \brief Encode a byte buffer one run of non-zero bytes at a time.
+    ///
+    /// Runs are found with ByteSearch and copied with `memcpy()`. The result
+    /// is identical to encodeBytes().
+    ///
+    /// \param buffer A pointer to the unencoded buffer to encode.
+    /// \param size  The number of bytes in the \p buffer.
+    /// \param encodedBuffer The buffer for the encoded bytes.
+    /// \returns The number of bytes written to the \p encodedBuffer.
+    static size_t encodeRuns(const uint8_t* buffer,
+                             size_t size,
+                             uint8_t* encodedBuffer)
+    {
+        size_t read_index  = 0;
+        size_t write_index = 0;
+
+        while (true)
+        {
+            size_t remaining = size - read_index;
+            size_t run = ByteSearch::find(buffer + read_index,
+                                          remaining < 254 ? remaining : 254,
+                                          0);
+
+            encodedBuffer[write_index++] = static_cast<uint8_t>(run + 1);
+            memcpy(encodedBuffer + write_index, buffer + read_index, run);
+            write_index += run;
+            read_index += run;
+
+            // A full block does not consume a zero.
+            if (run == 254)
+                continue;
+
+            if (read_index == size)
+                break;
+
+            // Skip the zero.
+            read_index++;
+        }
+
+        return write_index;
+    }
 
     /// \brief Decode a COBS-encoded buffer.
     /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
     /// \param size The number of bytes in the \p encodedBuffer.
     /// \param decodedBuffer The target buffer for the decoded bytes.
-    /// \returns The number of bytes written to the \p decodedBuffer.
+    /// \returns The number of bytes written to the \p decodedBuffer, or 0 if
+    ///          the buffer is not a valid COBS packet.
     /// \warning decodedBuffer must have a minimum capacity of size.
+    /// \sa tryDecode()
     static size_t decode(const uint8_t* encodedBuffer,
                          size_t size,
                          uint8_t* decodedBuffer)
     {
-        if (size == 0)
-            return 0;
+        size_t numDecoded = 0;
+        return tryDecode(encodedBuffer, size, decodedBuffer, numDecoded) ? numDecoded : 0;
+    }
+
+    /// \brief Decode a COBS-encoded buffer one byte at a time.
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \returns The number of bytes written to the \p decodedBuffer, or 0 if
+    ///          the buffer is not a valid COBS packet.
+    /// \sa tryDecodeBytes()
+    static size_t decodeBytes(const uint8_t* encodedBuffer,
+                              size_t size,
+                              uint8_t* decodedBuffer)
+    {
+        size_t numDecoded = 0;
+        return tryDecodeBytes(encodedBuffer, size, decodedBuffer, numDecoded) ? numDecoded : 0;
+    }
+
+    /// \brief Decode a COBS-encoded buffer one block at a time.
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \returns The number of bytes written to the \p decodedBuffer, or 0 if
+    ///          the buffer is not a valid COBS packet.
+    /// \sa tryDecodeRuns()
+    static size_t decodeRuns(const uint8_t* encodedBuffer,
+                             size_t size,
+                             uint8_t* decodedBuffer)
+    {
+        size_t numDecoded = 0;
+        return tryDecodeRuns(encodedBuffer, size, decodedBuffer, numDecoded) ? numDecoded : 0;
+    }
+
+    /// \brief Decode a COBS-encoded buffer and report invalid input.
+    ///
+    /// Unlike decode(), an invalid packet is distinguished from an empty one.
+    /// Every call reads each encoded byte at most once and writes at most
+    /// \p size decoded bytes, whatever the input.
+    ///
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \param numDecoded Set to the number of bytes written to the
+    ///        \p decodedBuffer.
+    /// \returns false if a code byte is 0 or its block extends past the end
+    ///          of the buffer. Data bytes are copied as they are.
+    /// \warning decodedBuffer must have a minimum capacity of size.
+    static bool tryDecode(const uint8_t* encodedBuffer,
+                          size_t size,
+                          uint8_t* decodedBuffer,
+                          size_t& numDecoded)
+    {
+#if PACKETSERIAL_USE_WORD_SEARCH
+        return tryDecodeRuns(encodedBuffer, size, decodedBuffer, numDecoded);
+#else
+        return tryDecodeBytes(encodedBuffer, size, decodedBuffer, numDecoded);
+#endif
+    }
 
+    /// \brief Decode a COBS-encoded buffer one byte at a time.
+    ///
+    /// This is the reference implementation used on platforms where
+    /// `PACKETSERIAL_USE_WORD_SEARCH` is disabled.
+    ///
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \param numDecoded Set to the number of bytes written to the
+    ///        \p decodedBuffer.
+    /// \returns false if the buffer is not a valid COBS packet.
+    /// \sa tryDecode()
+    static bool tryDecodeBytes(const uint8_t* encodedBuffer,
+                               size_t size,
+                               uint8_t* decodedBuffer,
+                               size_t& numDecoded)
+    {
         size_t read_index  = 0;
         size_t write_index = 0;
         uint8_t code       = 0;
         uint8_t i          = 0;
 
+        numDecoded = 0;
+
         while (read_index < size)
         {
             code = encodedBuffer[read_index];
 
-            if (read_index + code > size && code != 1)
+            if (code == 0 || read_index + code > size)
             {
-                return 0;
+                return false;
             }
 
             read_index++;
@@ -115,15 +256,315 @@ public:
             }
         }
 
-        return write_index;
+        numDecoded = write_index;
+        return true;
+    }
+
+    /// \brief Decode a COBS-encoded buffer one block at a time.
+    ///
+    /// Each block is copied with `memcpy()`. The result is identical to
+    /// tryDecodeBytes().
+    ///
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \param numDecoded Set to the number of bytes written to the
+    ///        \p decodedBuffer.
+    /// \returns false if the buffer is not a valid COBS packet.
+    /// \sa tryDecode()
+    static bool tryDecodeRuns(const uint8_t* encodedBuffer,
+                              size_t size,
+                              uint8_t* decodedBuffer,
+                              size_t& numDecoded)
+    {
+        size_t read_index  = 0;
+        size_t write_index = 0;
+
+        numDecoded = 0;
+
+        while (read_index < size)
+        {
+            uint8_t code = encodedBuffer[read_index];
+
+            if (code == 0 || read_index + code > size)
+            {
+                return false;
+            }
+
+            read_index++;
+
+            size_t run = code - 1;
+            memcpy(decodedBuffer + write_index, encodedBuffer + read_index, run);
+            write_index += run;
+            read_index += run;
+
+            if (code != 0xFF && read_index != size)
+            {
+                decodedBuffer[write_index++] = '\0';
+            }
+        }
+
+        numDecoded = write_index;
+        return true;
     }
 
+    /// \brief An incremental COBS encoder.
+    ///
+    /// The StreamEncoder writes the encoded packet directly to a sink (e.g. an
+    /// Arduino `Stream`) one COBS block at a time. Each block is written as a
+    /// code byte followed by at most 254 bytes taken directly from the
+    /// unencoded buffer, so no encode buffer is required.
+    ///
+    /// A sink is any type that implements:
+    ///
+    ///     size_t write(uint8_t data);
+    ///     size_t write(const uint8_t* buffer, size_t size);
+    ///
+    class StreamEncoder
+    {
+    public:
+        /// \brief Encode a byte buffer and write it to a sink.
+        /// \param buffer A pointer to the unencoded buffer to encode.
+        /// \param size  The number of bytes in the \p buffer.
+        /// \param sink The sink that receives the encoded bytes.
+        /// \returns The number of encoded bytes written to the \p sink.
+        template<typename Sink>
+        static size_t encode(const uint8_t* buffer, size_t size, Sink& sink)
+        {
+            PacketSegment segment = { buffer, size };
+            return encode(&segment, 1, sink);
+        }
+
+        /// \brief Encode a list of segments as one packet and write it to a sink.
+        ///
+        /// The COBS block state is carried across segment boundaries, so the
+        /// result is identical to encoding the concatenated segments.
+        ///
+        /// \param segments A pointer to the list of unencoded segments.
+        /// \param count The number of segments in the list.
+        /// \param sink The sink that receives the encoded bytes.
+        /// \returns The number of encoded bytes written to the \p sink.
+        template<typename Sink>
+        static size_t encode(const PacketSegment* segments,
+                             size_t count,
+                             Sink& sink)
+        {
+            return encodeSegments(segments, count, sink);
+        }
+
+        /// \brief Encode a list of segments and a trailer as one packet.
+        ///
+        /// This is equivalent to encoding the segments with the trailer (e.g.
+        /// a checksum) appended to the list.
+        ///
+        /// \param segments A pointer to the list of unencoded segments.
+        /// \param count The number of segments in the list.
+        /// \param trailer The segment encoded after the list.
+        /// \param sink The sink that receives the encoded bytes.
+        /// \returns The number of encoded bytes written to the \p sink.
+        template<typename Sink>
+        static size_t encode(const PacketSegment* segments,
+                             size_t count,
+                             const PacketSegment& trailer,
+                             Sink& sink)
+        {
+            TrailedSegments list = { segments, count, trailer };
+            return encodeSegments(list, count + 1, sink);
+        }
+
+    private:
+        struct TrailedSegments
+        {
+            const PacketSegment* segments;
+            size_t count;
+            const PacketSegment& trailer;
+
+            const PacketSegment& operator [] (size_t index) const
+            {
+                return index < count ? segments[index] : trailer;
+            }
+        };
+
+        template<typename Segments, typename Sink>
+        static size_t encodeSegments(const Segments& segments,
+                                     size_t count,
+                                     Sink& sink)
+        {
+            size_t segment     = 0;
+            size_t offset      = 0;
+            size_t write_count = 0;
+
+            while (true)
+            {
+                // Measure the next run of non-zero bytes.
+                size_t run_segment = segment;
+                size_t run_offset  = offset;
+                size_t run         = 0;
+                bool zero          = false;
+
+                while (run < 254 && run_segment < count)
+                {
+                    size_t available = segments[run_segment].size - run_offset;
+
+                    if (available == 0)
+                    {
+                        run_segment++;
+                        run_offset = 0;
+                        continue;
+                    }
+
+                    size_t limit = available < 254 - run ? available : 254 - run;
+                    size_t n = ByteSearch::find(segments[run_segment].buffer + run_offset,
+                                                limit,
+                                                0);
+                    run += n;
+                    run_offset += n;
+
+                    if (n < limit)
+                    {
+                        zero = true;
+                        break;
+                    }
+                }
+
+                sink.write(static_cast<uint8_t>(run + 1));
+                write_count += run + 1;
+
+                // Write the run directly from each segment that it spans.
+                size_t remaining = run;
+
+                while (remaining > 0)
+                {
+                    size_t available = segments[segment].size - offset;
+
+                    if (available == 0)
+                    {
+                        segment++;
+                        offset = 0;
+                        continue;
+                    }
+
+                    size_t n = available < remaining ? available : remaining;
+                    sink.write(segments[segment].buffer + offset, n);
+                    offset += n;
+                    remaining -= n;
+                }
+
+                segment = run_segment;
+                offset  = run_offset;
+
+                // A full block does not consume a zero.
+                if (run == 254)
+                    continue;
+
+                if (!zero)
+                    break;
+
+                // Skip the zero.
+                offset++;
+            }
+
+            return write_count;
+        }
+    };
+
+    /// \brief An incremental COBS decoder.
+    ///
+    /// The StreamDecoder decodes one encoded byte at a time, allowing a packet
+    /// to be decoded in place as it is received instead of being buffered and
+    /// decoded after the packet boundary arrives. The packet boundary byte is
+    /// never passed to the decoder. Instead, reset() is called at the start of
+    /// each packet and isValid() is checked when the packet boundary arrives.
+    ///
+    /// Each encoded byte produces at most one decoded byte, so the decoded
+    /// packet never needs more space than the encoded packet.
+    class StreamDecoder
+    {
+    public:
+        /// \brief Construct a StreamDecoder ready for a new packet.
+        StreamDecoder()
+        {
+            reset();
+        }
+
+        /// \brief Reset the decoder state for a new packet.
+        void reset()
+        {
+            // Starting with a full block suppresses the leading zero.
+            _code = 0xFF;
+            _remaining = 0;
+            _valid = true;
+        }
+
+        /// \brief Decode a single encoded byte.
+        /// \param encodedByte The next encoded byte of the packet.
+        /// \param decodedByte Set to the decoded byte, if one was produced.
+        /// \returns true if a decoded byte was produced.
+        bool decode(uint8_t encodedByte, uint8_t& decodedByte)
+        {
+            if (_remaining > 0)
+            {
+                _remaining--;
+                decodedByte = encodedByte;
+                return true;
+            }
+
+            // This is a code byte. The zero implied by the previous block is
+            // only emitted once we know that the packet continues.
+            bool emitZero = (_code != 0xFF);
+
+            _code = encodedByte;
+
+            if (_code == 0)
+            {
+                _valid = false;
+                return false;
+            }
+
+            _remaining = _code - 1;
+
+            if (emitZero)
+            {
+                decodedByte = 0;
+                return true;
+            }
+
+            return false;
+        }
+
+        /// \returns true if the bytes decoded so far form a complete packet.
+        bool isValid() const
+        {
+            return _valid && _remaining == 0;
+        }
+
+    private:
+        uint8_t _code;
+        uint8_t _remaining;
+        bool _valid;
+    };
+
     /// \brief Get the maximum encoded buffer size for an unencoded buffer size.
     /// \param unencodedBufferSize The size of the buffer to be encoded.
     /// \returns the maximum size of the required encoded buffer.
-    static size_t getEncodedBufferSize(size_t unencodedBufferSize)
+    static constexpr size_t getEncodedBufferSize(size_t unencodedBufferSize)
     {
         return unencodedBufferSize + unencodedBufferSize / 254 + 1;
     }
 
+    /// \brief Get the largest unencoded buffer size that fits an encoded buffer.
+    ///
+    /// This is the inverse of getEncodedBufferSize(): it returns the largest
+    /// size `n` for which `getEncodedBufferSize(n) <= encodedBufferSize`.
+    ///
+    /// \param encodedBufferSize The size of the encoded buffer.
+    /// \returns the maximum size of an unencoded buffer.
+    static constexpr size_t getMaxDecodedSize(size_t encodedBufferSize)
+    {
+        return encodedBufferSize == 0 ? 0 :
+               (encodedBufferSize - 1)
+               - (encodedBufferSize - 1) / 255
+               - ((encodedBufferSize - 1) % 255 == 254 ? 1 : 0);
+    }
+
 };
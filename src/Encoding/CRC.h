@@ -0,0 +1,361 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "Arduino.h"
+
+
+/// \brief The number of bytes the CRC kernels process per table lookup round.
+///
+/// - `0` computes the CRC bit by bit and uses no tables.
+/// - `1` uses one 256 entry table and processes one byte per lookup.
+/// - `4` or `8` use "slice-by-N" tables and process 4 or 8 bytes per round.
+///
+/// The tables are generated at compile time and are `const`, so on most 32-bit
+/// boards they are placed in flash. On AVR they would be copied to RAM, so the
+/// default there is `0`. Everywhere else the default is `1`.
+///
+/// Independent of this setting, `CRC32C` uses the SSE4.2 `crc32` instruction
+/// when `__SSE4_2__` is defined (e.g. on a host built with `-msse4.2`).
+#ifndef PACKETSERIAL_CRC_SLICES
+    #if defined(__AVR__)
+        #define PACKETSERIAL_CRC_SLICES 0
+    #else
+        #define PACKETSERIAL_CRC_SLICES 1
+    #endif
+#endif
+
+
+#if !(PACKETSERIAL_CRC_SLICES == 0 || PACKETSERIAL_CRC_SLICES == 1 || PACKETSERIAL_CRC_SLICES == 4 || PACKETSERIAL_CRC_SLICES == 8)
+    #error "PACKETSERIAL_CRC_SLICES must be 0, 1, 4 or 8."
+#endif
+
+
+#if defined(__SSE4_2__)
+    #include <nmmintrin.h>
+#endif
+
+
+/// \brief A compile-time list of indices used to generate the CRC tables.
+template<size_t... Indices>
+struct CRCIndexList
+{
+};
+
+
+template<typename First, typename Second>
+struct CRCConcatIndexList;
+
+
+template<size_t... First, size_t... Second>
+struct CRCConcatIndexList<CRCIndexList<First...>, CRCIndexList<Second...>>
+{
+    typedef CRCIndexList<First..., (sizeof...(First) + Second)...> Type;
+};
+
+
+/// \brief Makes the list of indices 0 to Size - 1.
+template<size_t Size>
+struct CRCMakeIndexList
+{
+    typedef typename CRCConcatIndexList<typename CRCMakeIndexList<Size / 2>::Type,
+                                        typename CRCMakeIndexList<Size - Size / 2>::Type>::Type Type;
+};
+
+
+template<>
+struct CRCMakeIndexList<0>
+{
+    typedef CRCIndexList<> Type;
+};
+
+
+template<>
+struct CRCMakeIndexList<1>
+{
+    typedef CRCIndexList<0> Type;
+};
+
+
+/// \brief A cyclic redundancy check (CRC).
+///
+/// The CRC of a packet is computed with begin(), update() and store(), e.g.:
+///
+///     CRC16::Value crc = CRC16::begin();
+///     crc = CRC16::update(crc, buffer, size);
+///     CRC16::store(crc, checksum);
+///
+/// The stored checksum is written in the byte order that lets the receiver
+/// run the CRC over the packet followed by its checksum and compare the
+/// result with a constant, so no bytes have to be held back:
+///
+///     CRC16::Value crc = CRC16::begin();
+///     crc = CRC16::update(crc, packetWithChecksum, size);
+///     bool valid = CRC16::check(crc);
+///
+/// \tparam ValueType The unsigned integer type of the CRC register.
+/// \tparam Polynomial The generator polynomial, bit-reversed if \p Reflected.
+/// \tparam Initial The initial register value.
+/// \tparam FinalXor The value XORed with the register to produce the checksum.
+/// \tparam Reflected True if bytes are processed least significant bit first.
+/// \tparam Residue The register value after a packet and its checksum.
+///
+/// \sa https://reveng.sourceforge.io/crc-catalogue/
+/// \sa https://create.stephan-brumme.com/crc32/#slicing-by-8-overview
+template<typename ValueType,
+         ValueType Polynomial,
+         ValueType Initial,
+         ValueType FinalXor,
+         bool Reflected,
+         ValueType Residue>
+class CRC_
+{
+public:
+    /// \brief The type of the CRC register.
+    typedef ValueType Value;
+
+    enum
+    {
+        /// \brief The number of bytes in the stored checksum.
+        Size = sizeof(Value),
+
+        /// \brief The number of bytes processed per lookup round.
+        Slices = PACKETSERIAL_CRC_SLICES
+    };
+
+    static_assert(Slices < 2 || Slices >= static_cast<int>(Size),
+                  "PACKETSERIAL_CRC_SLICES must be at least the CRC size.");
+
+    /// \returns the initial CRC register value.
+    static Value begin()
+    {
+        return Initial;
+    }
+
+    /// \brief Update the CRC register with one byte.
+    /// \param crc The current CRC register value.
+    /// \param data The next byte.
+    /// \returns the updated CRC register value.
+    static Value update(Value crc, uint8_t data)
+    {
+#if defined(__SSE4_2__)
+        if (isCRC32C())
+            return static_cast<Value>(_mm_crc32_u8(static_cast<uint32_t>(crc), data));
+#endif
+
+#if PACKETSERIAL_CRC_SLICES == 0
+        return updateBits(crc, data);
+#else
+        return Reflected ? static_cast<Value>((crc >> 8) ^ table(0, (crc ^ data) & 0xFF))
+                         : static_cast<Value>((crc << 8) ^ table(0, ((crc >> (Bits - 8)) ^ data) & 0xFF));
+#endif
+    }
+
+    /// \brief Update the CRC register with a buffer.
+    /// \param crc The current CRC register value.
+    /// \param buffer A pointer to the bytes.
+    /// \param size The number of bytes in the \p buffer.
+    /// \returns the updated CRC register value.
+    static Value update(Value crc, const uint8_t* buffer, size_t size)
+    {
+        size_t index = 0;
+
+#if defined(__SSE4_2__)
+        if (isCRC32C())
+        {
+            uint32_t crc32 = static_cast<uint32_t>(crc);
+
+    #if defined(__x86_64__)
+            while (index + 8 <= size)
+            {
+                uint64_t word;
+                memcpy(&word, buffer + index, 8);
+                crc32 = static_cast<uint32_t>(_mm_crc32_u64(crc32, word));
+                index += 8;
+            }
+    #endif
+            while (index + 4 <= size)
+            {
+                uint32_t word;
+                memcpy(&word, buffer + index, 4);
+                crc32 = _mm_crc32_u32(crc32, word);
+                index += 4;
+            }
+
+            crc = static_cast<Value>(crc32);
+        }
+#endif
+
+#if PACKETSERIAL_CRC_SLICES > 1
+        while (index + Slices <= size)
+        {
+            const uint8_t* data = buffer + index;
+            Value next = 0;
+
+            // The first Size bytes are combined with the register, the rest
+            // are looked up directly. Each table advances its byte by the
+            // number of bytes that follow it in this round.
+            for (size_t i = 0; i < Size; i++)
+            {
+                uint8_t byte = Reflected ? static_cast<uint8_t>(crc >> (8 * i))
+                                         : static_cast<uint8_t>(crc >> (Bits - 8 - 8 * i));
+                next ^= table(Slices - 1 - i, byte ^ data[i]);
+            }
+
+            for (size_t i = Size; i < Slices; i++)
+            {
+                next ^= table(Slices - 1 - i, data[i]);
+            }
+
+            crc = next;
+            index += Slices;
+        }
+#endif
+
+        while (index < size)
+        {
+            crc = update(crc, buffer[index++]);
+        }
+
+        return crc;
+    }
+
+    /// \brief Compute the checksum of a buffer.
+    /// \param buffer A pointer to the bytes.
+    /// \param size The number of bytes in the \p buffer.
+    /// \returns the checksum.
+    static Value compute(const uint8_t* buffer, size_t size)
+    {
+        return update(begin(), buffer, size) ^ FinalXor;
+    }
+
+    /// \brief Write the checksum for a CRC register value.
+    /// \param crc The CRC register value after the last byte of the packet.
+    /// \param checksum The buffer for the `Size` checksum bytes.
+    static void store(Value crc, uint8_t* checksum)
+    {
+        crc ^= FinalXor;
+
+        for (size_t i = 0; i < Size; i++)
+        {
+            checksum[i] = Reflected ? static_cast<uint8_t>(crc >> (8 * i))
+                                    : static_cast<uint8_t>(crc >> (Bits - 8 - 8 * i));
+        }
+    }
+
+    /// \brief Check a packet followed by its stored checksum.
+    /// \param crc The CRC register value after the last checksum byte.
+    /// \returns true if the checksum matches the packet.
+    static bool check(Value crc)
+    {
+        return crc == Residue;
+    }
+
+private:
+    enum
+    {
+        Bits = 8 * sizeof(Value),
+        TableSize = Slices < 1 ? 1 : Slices
+    };
+
+    static constexpr bool isCRC32C()
+    {
+        return sizeof(Value) == 4 && Reflected && Polynomial == static_cast<Value>(0x82F63B78);
+    }
+
+    static Value updateBits(Value crc, uint8_t data)
+    {
+        if (Reflected)
+        {
+            crc ^= data;
+
+            for (uint8_t bit = 0; bit < 8; bit++)
+            {
+                crc = (crc & 1) ? static_cast<Value>((crc >> 1) ^ Polynomial)
+                                : static_cast<Value>(crc >> 1);
+            }
+        }
+        else
+        {
+            crc ^= static_cast<Value>(static_cast<Value>(data) << (Bits - 8));
+
+            for (uint8_t bit = 0; bit < 8; bit++)
+            {
+                crc = (crc >> (Bits - 1)) ? static_cast<Value>((crc << 1) ^ Polynomial)
+                                          : static_cast<Value>(crc << 1);
+            }
+        }
+
+        return crc;
+    }
+
+    // Process the remaining bits of a single byte at compile time.
+    static constexpr Value shiftBits(Value crc, uint8_t bits)
+    {
+        return bits == 0 ? crc :
+               Reflected ? shiftBits((crc & 1) ? static_cast<Value>((crc >> 1) ^ Polynomial)
+                                               : static_cast<Value>(crc >> 1), bits - 1)
+                         : shiftBits((crc >> (Bits - 1)) ? static_cast<Value>((crc << 1) ^ Polynomial)
+                                                         : static_cast<Value>(crc << 1), bits - 1);
+    }
+
+    // The register after byte `data` followed by `zeros` zero bytes.
+    static constexpr Value entry(size_t zeros, size_t data)
+    {
+        return zeros == 0 ? shiftBits(Reflected ? static_cast<Value>(data)
+                                                : static_cast<Value>(static_cast<Value>(data) << (Bits - 8)), 8)
+                          : advance(entry(zeros - 1, data));
+    }
+
+    // Advance a register by one zero byte.
+    static constexpr Value advance(Value crc)
+    {
+        return Reflected ? static_cast<Value>((crc >> 8) ^ entry(0, crc & 0xFF))
+                         : static_cast<Value>((crc << 8) ^ entry(0, (crc >> (Bits - 8)) & 0xFF));
+    }
+
+    template<typename IndexList>
+    struct Table;
+
+    template<size_t... Indices>
+    struct Table<CRCIndexList<Indices...>>
+    {
+        static constexpr Value data[sizeof...(Indices)] = { entry(Indices / 256, Indices % 256)... };
+    };
+
+    typedef Table<typename CRCMakeIndexList<TableSize * 256>::Type> Tables;
+
+    static Value table(size_t slice, size_t index)
+    {
+        return Tables::data[slice * 256 + index];
+    }
+};
+
+
+template<typename ValueType, ValueType Polynomial, ValueType Initial, ValueType FinalXor, bool Reflected, ValueType Residue>
+template<size_t... Indices>
+constexpr ValueType CRC_<ValueType, Polynomial, Initial, FinalXor, Reflected, Residue>::Table<CRCIndexList<Indices...>>::data[sizeof...(Indices)];
+
+
+/// \brief CRC-16/CCITT-FALSE (also known as CRC-16/IBM-3740).
+///
+/// The checksum is stored most significant byte first.
+typedef CRC_<uint16_t, 0x1021, 0xFFFF, 0x0000, false, 0x0000> CRC16;
+
+/// \brief CRC-32 as used by Ethernet, zlib and PNG.
+///
+/// The checksum is stored least significant byte first.
+typedef CRC_<uint32_t, 0xEDB88320, 0xFFFFFFFF, 0xFFFFFFFF, true, 0xDEBB20E3> CRC32;
+
+/// \brief CRC-32C (Castagnoli) as used by iSCSI and SCTP.
+///
+/// The checksum is stored least significant byte first. This CRC has better
+/// error detection than CRC32 for short packets, and has hardware support on
+/// x86 processors with SSE4.2.
+typedef CRC_<uint32_t, 0x82F63B78, 0xFFFFFFFF, 0xFFFFFFFF, true, 0xB798B438> CRC32C;
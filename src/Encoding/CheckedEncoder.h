@@ -0,0 +1,251 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "Arduino.h"
+#include "CRC.h"
+#include "PacketSegment.h"
+
+
+/// \brief An encoder that adds a checksum to the packets of another encoder.
+///
+/// The checksum of each packet is appended to the packet before it is encoded
+/// and is checked and removed after the packet is decoded, so packet handlers
+/// only ever see packets with a valid checksum. Packets with an invalid
+/// checksum fail to decode and are dropped by PacketSerial_.
+///
+/// A CheckedEncoder is used in place of the encoder it wraps, e.g.:
+///
+///     PacketSerial_<CheckedEncoder<COBS, CRC16> > myPacketSerial;
+///     PacketSerial_<CheckedEncoder<SLIP, CRC32>, SLIP::END> mySLIPPacketSerial;
+///
+/// When sending, the checksum is computed over the unencoded packet with the
+/// bulk (table or slice-by-N) CRC kernel and then encoded as a trailing
+/// segment, so the packet is not copied. When receiving, the checksum is
+/// updated with each byte as it is decoded, so the packet is only read once.
+///
+/// \tparam EncoderType An encoder that provides a `StreamEncoder` and a
+///         `StreamDecoder`, e.g. `COBS` or `SLIP`.
+/// \tparam ChecksumType The checksum, e.g. `CRC16`, `CRC32` or `CRC32C`.
+template<typename EncoderType, typename ChecksumType>
+class CheckedEncoder
+{
+public:
+    /// \brief Encode a byte buffer and append its checksum.
+    /// \param buffer A pointer to the unencoded buffer to encode.
+    /// \param size  The number of bytes in the \p buffer.
+    /// \param encodedBuffer The buffer for the encoded bytes.
+    /// \returns The number of bytes written to the \p encodedBuffer.
+    /// \warning The encodedBuffer must have at least getEncodedBufferSize()
+    ///          allocated.
+    static size_t encode(const uint8_t* buffer,
+                         size_t size,
+                         uint8_t* encodedBuffer)
+    {
+        BufferSink sink = { encodedBuffer };
+        return StreamEncoder::encode(buffer, size, sink);
+    }
+
+    /// \brief Decode a packet and check and remove its checksum.
+    /// \param encodedBuffer A pointer to the encoded buffer to decode.
+    /// \param size  The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \returns The number of bytes written to the \p decodedBuffer, or 0 if
+    ///          the packet could not be decoded or its checksum is invalid.
+    /// \warning decodedBuffer must have a minimum capacity of size.
+    /// \sa tryDecode()
+    static size_t decode(const uint8_t* encodedBuffer,
+                         size_t size,
+                         uint8_t* decodedBuffer)
+    {
+        size_t numDecoded = 0;
+        return tryDecode(encodedBuffer, size, decodedBuffer, numDecoded) ? numDecoded : 0;
+    }
+
+    /// \brief Decode a packet, check and remove its checksum and report
+    ///        invalid input.
+    /// \param encodedBuffer A pointer to the encoded buffer to decode.
+    /// \param size  The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \param numDecoded Set to the number of bytes written to the
+    ///        \p decodedBuffer, excluding the checksum.
+    /// \returns false if the packet could not be decoded or its checksum is
+    ///          invalid.
+    /// \warning decodedBuffer must have a minimum capacity of size.
+    static bool tryDecode(const uint8_t* encodedBuffer,
+                          size_t size,
+                          uint8_t* decodedBuffer,
+                          size_t& numDecoded)
+    {
+        numDecoded = 0;
+
+        size_t numChecked = 0;
+
+        if (!EncoderType::tryDecode(encodedBuffer, size, decodedBuffer, numChecked) ||
+            numChecked < ChecksumType::Size ||
+            !ChecksumType::check(ChecksumType::update(ChecksumType::begin(),
+                                                      decodedBuffer,
+                                                      numChecked)))
+        {
+            return false;
+        }
+
+        numDecoded = numChecked - ChecksumType::Size;
+        return true;
+    }
+
+    /// \brief An incremental encoder that appends the checksum.
+    /// \sa COBS::StreamEncoder
+    class StreamEncoder
+    {
+    public:
+        /// \brief Encode a byte buffer and its checksum and write it to a sink.
+        /// \param buffer A pointer to the unencoded buffer to encode.
+        /// \param size  The number of bytes in the \p buffer.
+        /// \param sink The sink that receives the encoded bytes.
+        /// \returns The number of encoded bytes written to the \p sink.
+        template<typename Sink>
+        static size_t encode(const uint8_t* buffer, size_t size, Sink& sink)
+        {
+            PacketSegment segment = { buffer, size };
+            return encode(&segment, 1, sink);
+        }
+
+        /// \brief Encode a list of segments and their checksum as one packet.
+        /// \param segments A pointer to the list of unencoded segments.
+        /// \param count The number of segments in the list.
+        /// \param sink The sink that receives the encoded bytes.
+        /// \returns The number of encoded bytes written to the \p sink.
+        template<typename Sink>
+        static size_t encode(const PacketSegment* segments,
+                             size_t count,
+                             Sink& sink)
+        {
+            typename ChecksumType::Value crc = ChecksumType::begin();
+
+            for (size_t i = 0; i < count; i++)
+            {
+                crc = ChecksumType::update(crc, segments[i].buffer, segments[i].size);
+            }
+
+            uint8_t checksum[ChecksumType::Size];
+            ChecksumType::store(crc, checksum);
+
+            const PacketSegment trailer = { checksum, ChecksumType::Size };
+            return EncoderType::StreamEncoder::encode(segments, count, trailer, sink);
+        }
+    };
+
+    /// \brief An incremental decoder that checks and removes the checksum.
+    ///
+    /// The checksum is updated with each decoded byte. The last `Size`
+    /// decoded bytes are held back until the next byte arrives, so the
+    /// checksum bytes are never produced.
+    class StreamDecoder
+    {
+    public:
+        /// \brief Construct a StreamDecoder ready for a new packet.
+        StreamDecoder()
+        {
+            reset();
+        }
+
+        /// \brief Reset the decoder state for a new packet.
+        void reset()
+        {
+            _decoder.reset();
+            _crc = ChecksumType::begin();
+            _count = 0;
+            _index = 0;
+            _empty = true;
+        }
+
+        /// \brief Decode a single encoded byte.
+        /// \param encodedByte The next encoded byte of the packet.
+        /// \param decodedByte Set to the decoded byte, if one was produced.
+        /// \returns true if a decoded byte was produced.
+        bool decode(uint8_t encodedByte, uint8_t& decodedByte)
+        {
+            uint8_t data;
+
+            _empty = false;
+
+            if (!_decoder.decode(encodedByte, data))
+                return false;
+
+            _crc = ChecksumType::update(_crc, data);
+
+            // Hold back the last Size bytes, which may be the checksum.
+            bool full = _count == ChecksumType::Size;
+
+            decodedByte = _pending[_index];
+            _pending[_index] = data;
+            _index = (_index + 1) % ChecksumType::Size;
+
+            if (!full)
+                _count++;
+
+            return full;
+        }
+
+        /// \returns true if the bytes decoded so far form a complete packet
+        ///          with a valid checksum. Like the wrapped decoder, an empty
+        ///          packet is valid.
+        bool isValid() const
+        {
+            return _empty || (_decoder.isValid() &&
+                              _count == ChecksumType::Size &&
+                              ChecksumType::check(_crc));
+        }
+
+    private:
+        typename EncoderType::StreamDecoder _decoder;
+        typename ChecksumType::Value _crc;
+        uint8_t _pending[ChecksumType::Size];
+        uint8_t _count;
+        uint8_t _index;
+        bool _empty;
+    };
+
+    /// \brief Get the maximum encoded buffer size for an unencoded buffer size.
+    /// \param unencodedBufferSize The size of the buffer to be encoded.
+    /// \returns the maximum size of the required encoded buffer.
+    static constexpr size_t getEncodedBufferSize(size_t unencodedBufferSize)
+    {
+        return EncoderType::getEncodedBufferSize(unencodedBufferSize + ChecksumType::Size);
+    }
+
+    /// \brief Get the largest unencoded buffer size that fits an encoded buffer.
+    /// \param encodedBufferSize The size of the encoded buffer.
+    /// \returns the maximum size of an unencoded buffer.
+    static constexpr size_t getMaxDecodedSize(size_t encodedBufferSize)
+    {
+        return EncoderType::getMaxDecodedSize(encodedBufferSize) < ChecksumType::Size ? 0 :
+               EncoderType::getMaxDecodedSize(encodedBufferSize) - ChecksumType::Size;
+    }
+
+private:
+    struct BufferSink
+    {
+        uint8_t* buffer;
+
+        size_t write(uint8_t data)
+        {
+            *buffer++ = data;
+            return 1;
+        }
+
+        size_t write(const uint8_t* data, size_t size)
+        {
+            memcpy(buffer, data, size);
+            buffer += size;
+            return size;
+        }
+    };
+};
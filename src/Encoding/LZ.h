@@ -0,0 +1,232 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "Arduino.h"
+
+
+/// \brief The number of bits of the LZ compressor's hash table index.
+///
+/// The compressor finds repeated sequences with a hash table of
+/// `2 ^ PACKETSERIAL_LZ_HASH_BITS` 16-bit positions on the stack. More bits
+/// find more matches and use more stack. The default is 6 (128 bytes) on
+/// AVR and 10 (2 KiB) elsewhere.
+#ifndef PACKETSERIAL_LZ_HASH_BITS
+    #if defined(__AVR__)
+        #define PACKETSERIAL_LZ_HASH_BITS 6
+    #else
+        #define PACKETSERIAL_LZ_HASH_BITS 10
+    #endif
+#endif
+
+
+/// \brief A small LZ77 compressor for packets with repeated sequences.
+///
+/// The compressed data is a list of blocks, each starting with a control
+/// byte `c`:
+///
+/// - `c < 128`: `c + 1` literal bytes follow.
+/// - `c >= 128`: a match of `(c & 127) + 3` bytes. One byte follows, which
+///   is the distance back to the start of the match minus 1.
+///
+/// Matches refer to earlier bytes of the same packet, up to 256 bytes back,
+/// so the decompressor needs no working memory and packets are compressed
+/// independently of each other. Unlike RLE, repeated multi-byte values, such
+/// as a sensor reading that does not change, are compressed too.
+///
+/// \sa CompressedPacketSerial_
+class LZ
+{
+public:
+    /// \brief Compress a buffer.
+    /// \param buffer A pointer to the buffer to compress.
+    /// \param size The number of bytes in the \p buffer.
+    /// \param compressedBuffer The buffer for the compressed bytes.
+    /// \param capacity The number of bytes available in \p compressedBuffer.
+    /// \returns the number of compressed bytes, or 0 if they do not fit in
+    ///          \p capacity bytes.
+    static size_t compress(const uint8_t* buffer,
+                           size_t size,
+                           uint8_t* compressedBuffer,
+                           size_t capacity)
+    {
+        // Positions are stored as 16-bit values.
+        if (size >= NoPosition)
+            return 0;
+
+        uint16_t table[HashSize];
+        memset(table, 0xFF, sizeof(table));
+
+        size_t read_index = 0;
+        size_t write_index = 0;
+        size_t literal_index = 0;
+
+        while (size - read_index >= MinMatch)
+        {
+            uint32_t hash = getHash(buffer + read_index);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint16_t>(read_index);
+
+            if (candidate == NoPosition ||
+                read_index - candidate > MaxDistance ||
+                memcmp(buffer + candidate, buffer + read_index, MinMatch) != 0)
+            {
+                read_index++;
+                continue;
+            }
+
+            size_t length = MinMatch;
+
+            while (read_index + length < size &&
+                   length < MaxMatch &&
+                   buffer[candidate + length] == buffer[read_index + length])
+            {
+                length++;
+            }
+
+            if (!writeLiterals(buffer + literal_index,
+                               read_index - literal_index,
+                               compressedBuffer,
+                               capacity,
+                               write_index) ||
+                capacity - write_index < 2)
+            {
+                return 0;
+            }
+
+            compressedBuffer[write_index++] = static_cast<uint8_t>(128 + length - MinMatch);
+            compressedBuffer[write_index++] = static_cast<uint8_t>(read_index - candidate - 1);
+
+            read_index += length;
+            literal_index = read_index;
+        }
+
+        if (!writeLiterals(buffer + literal_index,
+                           size - literal_index,
+                           compressedBuffer,
+                           capacity,
+                           write_index))
+        {
+            return 0;
+        }
+
+        return write_index;
+    }
+
+    /// \brief Decompress a buffer.
+    /// \param compressedBuffer A pointer to the compressed bytes.
+    /// \param size The number of bytes in the \p compressedBuffer.
+    /// \param buffer The buffer for the decompressed bytes.
+    /// \param capacity The number of bytes available in \p buffer.
+    /// \returns the number of decompressed bytes, or 0 if the compressed
+    ///          bytes are invalid or do not fit in \p capacity bytes.
+    static size_t decompress(const uint8_t* compressedBuffer,
+                             size_t size,
+                             uint8_t* buffer,
+                             size_t capacity)
+    {
+        size_t read_index = 0;
+        size_t write_index = 0;
+
+        while (read_index < size)
+        {
+            uint8_t control = compressedBuffer[read_index++];
+
+            if (control < 128)
+            {
+                size_t count = static_cast<size_t>(control) + 1;
+
+                if (size - read_index < count || capacity - write_index < count)
+                    return 0;
+
+                memcpy(buffer + write_index, compressedBuffer + read_index, count);
+                read_index += count;
+                write_index += count;
+            }
+            else
+            {
+                size_t count = static_cast<size_t>(control & 127) + MinMatch;
+
+                if (read_index == size || capacity - write_index < count)
+                    return 0;
+
+                size_t distance = static_cast<size_t>(compressedBuffer[read_index++]) + 1;
+
+                if (distance > write_index)
+                    return 0;
+
+                // Matches may overlap the bytes they produce, so copy bytewise.
+                const uint8_t* match = buffer + write_index - distance;
+
+                for (size_t i = 0; i < count; i++)
+                {
+                    buffer[write_index + i] = match[i];
+                }
+
+                write_index += count;
+            }
+        }
+
+        return write_index;
+    }
+
+private:
+    enum
+    {
+        /// \brief The shortest match that is compressed.
+        MinMatch = 3,
+
+        /// \brief The longest match that is compressed.
+        MaxMatch = 130,
+
+        /// \brief The largest distance of a match.
+        MaxDistance = 256,
+
+        /// \brief The largest number of literals in a block.
+        MaxLiterals = 128,
+
+        /// \brief The number of hash table entries.
+        HashSize = 1 << PACKETSERIAL_LZ_HASH_BITS,
+
+        /// \brief An empty hash table entry.
+        NoPosition = 0xFFFF
+    };
+
+    static uint32_t getHash(const uint8_t* buffer)
+    {
+        uint32_t value = buffer[0] |
+                         (static_cast<uint32_t>(buffer[1]) << 8) |
+                         (static_cast<uint32_t>(buffer[2]) << 16);
+
+        return static_cast<uint32_t>(value * 2654435761UL) >> (32 - PACKETSERIAL_LZ_HASH_BITS);
+    }
+
+    static bool writeLiterals(const uint8_t* buffer,
+                              size_t size,
+                              uint8_t* compressedBuffer,
+                              size_t capacity,
+                              size_t& write_index)
+    {
+        while (size > 0)
+        {
+            size_t count = size < MaxLiterals ? size : static_cast<size_t>(MaxLiterals);
+
+            if (capacity - write_index < count + 1)
+                return false;
+
+            compressedBuffer[write_index++] = static_cast<uint8_t>(count - 1);
+            memcpy(compressedBuffer + write_index, buffer, count);
+            write_index += count;
+            buffer += count;
+            size -= count;
+        }
+
+        return true;
+    }
+};
@@ -0,0 +1,49 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "Arduino.h"
+
+
+/// \brief A contiguous part of a packet.
+///
+/// A packet may be described by a list of segments (e.g. a header, a payload
+/// and a checksum) that are encoded as a single packet without first being
+/// copied into one buffer.
+///
+///     PacketSegment segments[3] = {
+///         { reinterpret_cast<const uint8_t*>(&header), sizeof(header) },
+///         { payload, payloadSize },
+///         { reinterpret_cast<const uint8_t*>(&checksum), sizeof(checksum) }
+///     };
+///
+struct PacketSegment
+{
+    /// \brief A pointer to the segment's bytes.
+    const uint8_t* buffer;
+
+    /// \brief The number of bytes in the \p buffer.
+    size_t size;
+
+    /// \brief Get the total number of bytes in a list of segments.
+    /// \param segments A pointer to the list of segments.
+    /// \param count The number of segments in the list.
+    /// \returns the total number of bytes in all segments.
+    static size_t totalSize(const PacketSegment* segments, size_t count)
+    {
+        size_t size = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            size += segments[i].size;
+        }
+
+        return size;
+    }
+};
@@ -0,0 +1,152 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "Arduino.h"
+
+
+/// \brief A run-length compressor for packets with repeated bytes.
+///
+/// The compressed data is a list of blocks, each starting with a control
+/// byte `c`:
+///
+/// - `c < 128`: `c + 1` literal bytes follow.
+/// - `c >= 128`: one byte follows, which is repeated `c - 125` times.
+///
+/// Runs of 3 to 130 equal bytes, such as the zeros of a sparse sensor array,
+/// are compressed to 2 bytes. Other bytes cost one extra byte per 128. The
+/// compressor needs no working memory.
+///
+/// \sa CompressedPacketSerial_
+class RLE
+{
+public:
+    /// \brief Compress a buffer.
+    /// \param buffer A pointer to the buffer to compress.
+    /// \param size The number of bytes in the \p buffer.
+    /// \param compressedBuffer The buffer for the compressed bytes.
+    /// \param capacity The number of bytes available in \p compressedBuffer.
+    /// \returns the number of compressed bytes, or 0 if they do not fit in
+    ///          \p capacity bytes.
+    static size_t compress(const uint8_t* buffer,
+                           size_t size,
+                           uint8_t* compressedBuffer,
+                           size_t capacity)
+    {
+        size_t read_index = 0;
+        size_t write_index = 0;
+
+        while (read_index < size)
+        {
+            size_t run = getRunLength(buffer + read_index, size - read_index);
+
+            if (run >= MinRun)
+            {
+                if (capacity - write_index < 2)
+                    return 0;
+
+                compressedBuffer[write_index++] = static_cast<uint8_t>(run + 125);
+                compressedBuffer[write_index++] = buffer[read_index];
+                read_index += run;
+                continue;
+            }
+
+            // Collect literals until the next run or the maximum block size.
+            size_t start = read_index;
+
+            while (read_index < size &&
+                   read_index - start < MaxLiterals &&
+                   getRunLength(buffer + read_index, size - read_index) < MinRun)
+            {
+                read_index++;
+            }
+
+            size_t count = read_index - start;
+
+            if (capacity - write_index < count + 1)
+                return 0;
+
+            compressedBuffer[write_index++] = static_cast<uint8_t>(count - 1);
+            memcpy(compressedBuffer + write_index, buffer + start, count);
+            write_index += count;
+        }
+
+        return write_index;
+    }
+
+    /// \brief Decompress a buffer.
+    /// \param compressedBuffer A pointer to the compressed bytes.
+    /// \param size The number of bytes in the \p compressedBuffer.
+    /// \param buffer The buffer for the decompressed bytes.
+    /// \param capacity The number of bytes available in \p buffer.
+    /// \returns the number of decompressed bytes, or 0 if the compressed
+    ///          bytes are invalid or do not fit in \p capacity bytes.
+    static size_t decompress(const uint8_t* compressedBuffer,
+                             size_t size,
+                             uint8_t* buffer,
+                             size_t capacity)
+    {
+        size_t read_index = 0;
+        size_t write_index = 0;
+
+        while (read_index < size)
+        {
+            uint8_t control = compressedBuffer[read_index++];
+
+            if (control < 128)
+            {
+                size_t count = static_cast<size_t>(control) + 1;
+
+                if (size - read_index < count || capacity - write_index < count)
+                    return 0;
+
+                memcpy(buffer + write_index, compressedBuffer + read_index, count);
+                read_index += count;
+                write_index += count;
+            }
+            else
+            {
+                size_t count = static_cast<size_t>(control) - 125;
+
+                if (read_index == size || capacity - write_index < count)
+                    return 0;
+
+                memset(buffer + write_index, compressedBuffer[read_index++], count);
+                write_index += count;
+            }
+        }
+
+        return write_index;
+    }
+
+private:
+    enum
+    {
+        /// \brief The shortest run that is compressed.
+        MinRun = 3,
+
+        /// \brief The longest run that is compressed.
+        MaxRun = 130,
+
+        /// \brief The largest number of literals in a block.
+        MaxLiterals = 128
+    };
+
+    static size_t getRunLength(const uint8_t* buffer, size_t size)
+    {
+        size_t run = 1;
+
+        while (run < size && run < MaxRun && buffer[run] == buffer[0])
+        {
+            run++;
+        }
+
+        return run;
+    }
+};
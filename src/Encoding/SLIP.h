@@ -10,6 +10,8 @@
 
 
 #include "Arduino.h"
+#include "ByteSearch.h"
+#include "PacketSegment.h"
 
 
 /// \brief A Serial Line Internet Protocol (SLIP) Encoder.
@@ -35,6 +37,26 @@ public:
                          size_t size,
                          uint8_t* encodedBuffer)
     {
+#if PACKETSERIAL_USE_WORD_SEARCH
+        return encodeRuns(buffer, size, encodedBuffer);
+#else
+        return encodeBytes(buffer, size, encodedBuffer);
+#endif
+    }
+
+    /// \brief Encode a byte buffer one byte at a time.
+    ///
+    /// This is the reference implementation used on platforms where
+    /// `PACKETSERIAL_USE_WORD_SEARCH` is disabled.
+    ///
+    /// \param buffer A pointer to the unencoded buffer to encode.
+    /// \param size  The number of bytes in the \p buffer.
+    /// \param encodedBuffer The buffer for the encoded bytes.
+    /// \returns The number of bytes written to the \p encodedBuffer.
+    static size_t encodeBytes(const uint8_t* buffer,
+                              size_t size,
+                              uint8_t* encodedBuffer)
+    {
         if (size == 0)
             return 0;
 
@@ -68,22 +90,144 @@ public:
         return write_index;
     }
 
+    /// \brief Encode a byte buffer one run of unescaped bytes at a time.
+    ///
+    /// Runs are found with ByteSearch and copied with `memcpy()`. The result
+    /// is identical to encodeBytes().
+    ///
+    /// \param buffer A pointer to the unencoded buffer to encode.
+    /// \param size  The number of bytes in the \p buffer.
+    /// \param encodedBuffer The buffer for the encoded bytes.
+    /// \returns The number of bytes written to the \p encodedBuffer.
+    static size_t encodeRuns(const uint8_t* buffer,
+                             size_t size,
+                             uint8_t* encodedBuffer)
+    {
+        if (size == 0)
+            return 0;
+
+        size_t read_index  = 0;
+        size_t write_index = 0;
+
+        // Double-ENDed, flush any data that may have accumulated due to line 
+        // noise.
+        encodedBuffer[write_index++] = END;
+
+        while (read_index < size)
+        {
+            size_t run = ByteSearch::findEither(buffer + read_index,
+                                                size - read_index,
+                                                END,
+                                                ESC);
+
+            memcpy(encodedBuffer + write_index, buffer + read_index, run);
+            write_index += run;
+            read_index += run;
+
+            if (read_index < size)
+            {
+                encodedBuffer[write_index++] = ESC;
+                encodedBuffer[write_index++] = buffer[read_index++] == END ? ESC_END : ESC_ESC;
+            }
+        }
+
+        return write_index;
+    }
+
     /// \brief Decode a SLIP-encoded buffer.
     /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
     /// \param size The number of bytes in the \p encodedBuffer.
     /// \param decodedBuffer The target buffer for the decoded bytes.
-    /// \returns The number of bytes written to the \p decodedBuffer.
+    /// \returns The number of bytes written to the \p decodedBuffer, or 0 if
+    ///          the buffer contains an invalid escape sequence.
     /// \warning decodedBuffer must have a minimum capacity of size.
+    /// \sa tryDecode()
     static size_t decode(const uint8_t* encodedBuffer,
                          size_t size,
                          uint8_t* decodedBuffer)
     {
-        if (size == 0)
-            return 0;
+        size_t numDecoded = 0;
+        return tryDecode(encodedBuffer, size, decodedBuffer, numDecoded) ? numDecoded : 0;
+    }
 
+    /// \brief Decode a SLIP-encoded buffer one byte at a time.
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \returns The number of bytes written to the \p decodedBuffer, or 0 if
+    ///          the buffer contains an invalid escape sequence.
+    /// \sa tryDecodeBytes()
+    static size_t decodeBytes(const uint8_t* encodedBuffer,
+                              size_t size,
+                              uint8_t* decodedBuffer)
+    {
+        size_t numDecoded = 0;
+        return tryDecodeBytes(encodedBuffer, size, decodedBuffer, numDecoded) ? numDecoded : 0;
+    }
+
+    /// \brief Decode a SLIP-encoded buffer one run of unescaped bytes at a time.
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \returns The number of bytes written to the \p decodedBuffer, or 0 if
+    ///          the buffer contains an invalid escape sequence.
+    /// \sa tryDecodeRuns()
+    static size_t decodeRuns(const uint8_t* encodedBuffer,
+                             size_t size,
+                             uint8_t* decodedBuffer)
+    {
+        size_t numDecoded = 0;
+        return tryDecodeRuns(encodedBuffer, size, decodedBuffer, numDecoded) ? numDecoded : 0;
+    }
+
+    /// \brief Decode a SLIP-encoded buffer and report invalid input.
+    ///
+    /// Unlike decode(), an invalid packet is distinguished from an empty one.
+    /// Every call reads each encoded byte at most once and writes at most
+    /// \p size decoded bytes, whatever the input.
+    ///
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \param numDecoded Set to the number of bytes written to the
+    ///        \p decodedBuffer.
+    /// \returns false if the buffer contains an invalid escape sequence, i.e.
+    ///          an `ESC` that is not followed by `ESC_END` or `ESC_ESC`.
+    /// \warning decodedBuffer must have a minimum capacity of size.
+    static bool tryDecode(const uint8_t* encodedBuffer,
+                          size_t size,
+                          uint8_t* decodedBuffer,
+                          size_t& numDecoded)
+    {
+#if PACKETSERIAL_USE_WORD_SEARCH
+        return tryDecodeRuns(encodedBuffer, size, decodedBuffer, numDecoded);
+#else
+        return tryDecodeBytes(encodedBuffer, size, decodedBuffer, numDecoded);
+#endif
+    }
+
+    /// \brief Decode a SLIP-encoded buffer one byte at a time.
+    ///
+    /// This is the reference implementation used on platforms where
+    /// `PACKETSERIAL_USE_WORD_SEARCH` is disabled.
+    ///
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \param numDecoded Set to the number of bytes written to the
+    ///        \p decodedBuffer.
+    /// \returns false if the buffer contains an invalid escape sequence.
+    /// \sa tryDecode()
+    static bool tryDecodeBytes(const uint8_t* encodedBuffer,
+                               size_t size,
+                               uint8_t* decodedBuffer,
+                               size_t& numDecoded)
+    {
         size_t read_index  = 0;
         size_t write_index = 0;
 
+        numDecoded = 0;
+
         while (read_index < size)
         {
             if (encodedBuffer[read_index] == END)
@@ -93,12 +237,12 @@ public:
             }
             else if (encodedBuffer[read_index] == ESC)
             {
-                if (encodedBuffer[read_index+1] == ESC_END)
+                if (read_index + 1 < size && encodedBuffer[read_index+1] == ESC_END)
                 {
                     decodedBuffer[write_index++] = END;
                     read_index += 2;
                 }
-                else if (encodedBuffer[read_index+1] == ESC_ESC)
+                else if (read_index + 1 < size && encodedBuffer[read_index+1] == ESC_ESC)
                 {
                     decodedBuffer[write_index++] = ESC;
                     read_index += 2;
@@ -106,6 +250,7 @@ public:
                 else
                 {
                     // This case is considered a protocol violation.
+                    return false;
                 }
             }
             else
@@ -114,9 +259,265 @@ public:
             }
         }
 
-        return write_index;
+        numDecoded = write_index;
+        return true;
     }
 
+    /// \brief Decode a SLIP-encoded buffer one run of unescaped bytes at a time.
+    ///
+    /// Runs are found with ByteSearch and copied with `memcpy()`. The result
+    /// is identical to tryDecodeBytes().
+    ///
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \param numDecoded Set to the number of bytes written to the
+    ///        \p decodedBuffer.
+    /// \returns false if the buffer contains an invalid escape sequence.
+    /// \sa tryDecode()
+    static bool tryDecodeRuns(const uint8_t* encodedBuffer,
+                              size_t size,
+                              uint8_t* decodedBuffer,
+                              size_t& numDecoded)
+    {
+        size_t read_index  = 0;
+        size_t write_index = 0;
+
+        numDecoded = 0;
+
+        while (read_index < size)
+        {
+            size_t run = ByteSearch::findEither(encodedBuffer + read_index,
+                                                size - read_index,
+                                                END,
+                                                ESC);
+
+            memcpy(decodedBuffer + write_index, encodedBuffer + read_index, run);
+            write_index += run;
+            read_index += run;
+
+            if (read_index == size)
+            {
+                break;
+            }
+            else if (encodedBuffer[read_index] == END)
+            {
+                // flush or done
+                read_index++;
+            }
+            else if (read_index + 1 < size
+                  && encodedBuffer[read_index + 1] == ESC_END)
+            {
+                decodedBuffer[write_index++] = END;
+                read_index += 2;
+            }
+            else if (read_index + 1 < size
+                  && encodedBuffer[read_index + 1] == ESC_ESC)
+            {
+                decodedBuffer[write_index++] = ESC;
+                read_index += 2;
+            }
+            else
+            {
+                // This case is considered a protocol violation.
+                return false;
+            }
+        }
+
+        numDecoded = write_index;
+        return true;
+    }
+
+    /// \brief An incremental SLIP encoder.
+    ///
+    /// The StreamEncoder writes the encoded packet directly to a sink (e.g. an
+    /// Arduino `Stream`). Runs of bytes that need no escaping are written
+    /// directly from the unencoded buffer, so no encode buffer is required.
+    ///
+    /// A sink is any type that implements:
+    ///
+    ///     size_t write(uint8_t data);
+    ///     size_t write(const uint8_t* buffer, size_t size);
+    ///
+    class StreamEncoder
+    {
+    public:
+        /// \brief Encode a byte buffer and write it to a sink.
+        /// \param buffer A pointer to the unencoded buffer to encode.
+        /// \param size  The number of bytes in the \p buffer.
+        /// \param sink The sink that receives the encoded bytes.
+        /// \returns The number of encoded bytes written to the \p sink.
+        template<typename Sink>
+        static size_t encode(const uint8_t* buffer, size_t size, Sink& sink)
+        {
+            PacketSegment segment = { buffer, size };
+            return encode(&segment, 1, sink);
+        }
+
+        /// \brief Encode a list of segments as one packet and write it to a sink.
+        /// \param segments A pointer to the list of unencoded segments.
+        /// \param count The number of segments in the list.
+        /// \param sink The sink that receives the encoded bytes.
+        /// \returns The number of encoded bytes written to the \p sink.
+        template<typename Sink>
+        static size_t encode(const PacketSegment* segments,
+                             size_t count,
+                             Sink& sink)
+        {
+            const PacketSegment trailer = { nullptr, 0 };
+            return encode(segments, count, trailer, sink);
+        }
+
+        /// \brief Encode a list of segments and a trailer as one packet.
+        ///
+        /// This is equivalent to encoding the segments with the trailer (e.g.
+        /// a checksum) appended to the list.
+        ///
+        /// \param segments A pointer to the list of unencoded segments.
+        /// \param count The number of segments in the list.
+        /// \param trailer The segment encoded after the list.
+        /// \param sink The sink that receives the encoded bytes.
+        /// \returns The number of encoded bytes written to the \p sink.
+        template<typename Sink>
+        static size_t encode(const PacketSegment* segments,
+                             size_t count,
+                             const PacketSegment& trailer,
+                             Sink& sink)
+        {
+            if (PacketSegment::totalSize(segments, count) + trailer.size == 0)
+                return 0;
+
+            size_t write_count = 0;
+
+            // Double-ENDed, flush any data that may have accumulated due to
+            // line noise.
+            sink.write(static_cast<uint8_t>(END));
+            write_count++;
+
+            for (size_t i = 0; i < count; i++)
+            {
+                write_count += writeRuns(segments[i].buffer,
+                                         segments[i].size,
+                                         sink);
+            }
+
+            write_count += writeRuns(trailer.buffer, trailer.size, sink);
+
+            return write_count;
+        }
+
+    private:
+        template<typename Sink>
+        static size_t writeRuns(const uint8_t* buffer, size_t size, Sink& sink)
+        {
+            size_t read_index  = 0;
+            size_t write_count = 0;
+
+            while (read_index < size)
+            {
+                size_t run = ByteSearch::findEither(buffer + read_index,
+                                                    size - read_index,
+                                                    END,
+                                                    ESC);
+
+                if (run > 0)
+                {
+                    sink.write(buffer + read_index, run);
+                    write_count += run;
+                    read_index += run;
+                }
+
+                if (read_index < size)
+                {
+                    const uint8_t escaped[2] = {
+                        ESC,
+                        static_cast<uint8_t>(buffer[read_index] == END ? ESC_END : ESC_ESC)
+                    };
+
+                    sink.write(escaped, 2);
+                    write_count += 2;
+                    read_index++;
+                }
+            }
+
+            return write_count;
+        }
+    };
+
+    /// \brief An incremental SLIP decoder.
+    ///
+    /// The StreamDecoder decodes one encoded byte at a time, allowing a packet
+    /// to be decoded in place as it is received instead of being buffered and
+    /// decoded after the packet boundary arrives. The packet boundary byte is
+    /// never passed to the decoder. Instead, reset() is called at the start of
+    /// each packet and isValid() is checked when the packet boundary arrives.
+    class StreamDecoder
+    {
+    public:
+        /// \brief Construct a StreamDecoder ready for a new packet.
+        StreamDecoder()
+        {
+            reset();
+        }
+
+        /// \brief Reset the decoder state for a new packet.
+        void reset()
+        {
+            _escape = false;
+            _valid = true;
+        }
+
+        /// \brief Decode a single encoded byte.
+        /// \param encodedByte The next encoded byte of the packet.
+        /// \param decodedByte Set to the decoded byte, if one was produced.
+        /// \returns true if a decoded byte was produced.
+        bool decode(uint8_t encodedByte, uint8_t& decodedByte)
+        {
+            if (_escape)
+            {
+                _escape = false;
+
+                if (encodedByte == ESC_END)
+                {
+                    decodedByte = END;
+                    return true;
+                }
+                else if (encodedByte == ESC_ESC)
+                {
+                    decodedByte = ESC;
+                    return true;
+                }
+
+                // This case is considered a protocol violation.
+                _valid = false;
+                return false;
+            }
+            else if (encodedByte == ESC)
+            {
+                _escape = true;
+                return false;
+            }
+            else if (encodedByte == END)
+            {
+                // flush
+                return false;
+            }
+
+            decodedByte = encodedByte;
+            return true;
+        }
+
+        /// \returns true if the bytes decoded so far form a complete packet.
+        bool isValid() const
+        {
+            return _valid && !_escape;
+        }
+
+    private:
+        bool _escape;
+        bool _valid;
+    };
+
     /// \brief Get the maximum encoded buffer size for an unencoded buffer size.
     ///
     /// SLIP has a start and end markers (192 and 219). Marker value is
@@ -126,11 +527,23 @@ public:
     ///
     /// \param unencodedBufferSize The size of the buffer to be encoded.
     /// \returns the maximum size of the required encoded buffer.
-    static size_t getEncodedBufferSize(size_t unencodedBufferSize)
+    static constexpr size_t getEncodedBufferSize(size_t unencodedBufferSize)
     {
         return unencodedBufferSize * 2 + 2;
     }
 
+    /// \brief Get the largest unencoded buffer size that fits an encoded buffer.
+    ///
+    /// This is the inverse of getEncodedBufferSize(): it returns the largest
+    /// size `n` for which `getEncodedBufferSize(n) <= encodedBufferSize`.
+    ///
+    /// \param encodedBufferSize The size of the encoded buffer.
+    /// \returns the maximum size of an unencoded buffer.
+    static constexpr size_t getMaxDecodedSize(size_t encodedBufferSize)
+    {
+        return encodedBufferSize < 2 ? 0 : (encodedBufferSize - 2) / 2;
+    }
+
     /// \brief Key constants used in the SLIP protocol.
     enum
     {
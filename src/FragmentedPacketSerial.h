@@ -0,0 +1,302 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "PacketSerial.h"
+
+
+/// \brief A PacketSerial_ that sends messages larger than a packet as a
+///        series of fragments.
+///
+/// Each message is split into fragments of at most `FragmentSize` bytes,
+/// which are sent as packets one after the other. The receiver passes each
+/// fragment to a message sink as it arrives, so a message is never held in
+/// RAM as a whole and the receive buffer only has to hold one fragment. A
+/// message sink is any type that implements:
+///
+///     // Called with the size of a new message. Return false to ignore it.
+///     bool begin(uint32_t size);
+///
+///     // Called with the next bytes of the message, in order. Return false
+///     // to abort the message.
+///     bool write(const uint8_t* buffer, size_t size);
+///
+///     // Called when the message is complete, or with false if it was
+///     // aborted or a fragment was lost.
+///     void end(bool complete);
+///
+/// e.g. a sink that writes a firmware image to flash:
+///
+///     struct FirmwareSink
+///     {
+///         bool begin(uint32_t size) { return size <= FLASH_SIZE && eraseFlash(); }
+///         bool write(const uint8_t* buffer, size_t size) { return writeFlash(buffer, size); }
+///         void end(bool complete) { if (complete) markImageValid(); }
+///     };
+///
+///     FirmwareSink mySink;
+///     FragmentedPacketSerial<FirmwareSink> myPacketSerial(mySink);
+///
+/// Each fragment starts with a 2 byte header:
+///
+/// - Bit 7 is set on the first fragment of a message and bit 6 on the last.
+///   Bits 0 to 5 are the message number, which counts messages modulo 64.
+/// - The fragment number, which counts the fragments of a message modulo 256.
+///
+/// The first fragment then holds the size of the message as a 32 bit
+/// little-endian number. If a fragment is lost or corrupted, the message is
+/// aborted and the fragments up to the start of the next message are
+/// ignored. Use a `CheckedEncoder` to detect corrupted fragments.
+///
+/// \tparam MessageSinkType The type of the message sink.
+/// \tparam PacketSerialType The PacketSerial_ type that sends the fragments.
+///         It must accept packets of `FragmentSize + 6` bytes.
+/// \tparam FragmentSize The maximum number of message bytes in a fragment.
+template<typename MessageSinkType,
+         typename PacketSerialType = PacketSerial,
+         size_t FragmentSize = 240>
+class FragmentedPacketSerial_
+{
+public:
+    static_assert(FragmentSize > 0, "FragmentSize must be greater than 0.");
+
+    enum
+    {
+        /// \brief The number of header bytes of each fragment.
+        HeaderSize = 2,
+
+        /// \brief The number of header bytes of the first fragment of a
+        ///        message.
+        FirstHeaderSize = 6
+    };
+
+    static_assert(FragmentSize + FirstHeaderSize <= PacketSerialType::MaxDecodedSize,
+                  "PacketSerialType must accept packets of FragmentSize + 6 bytes.");
+
+    /// \brief Construct a FragmentedPacketSerial_ without a stream.
+    /// \param messageSink The sink that receives messages. It must outlive
+    ///        the FragmentedPacketSerial_.
+    explicit FragmentedPacketSerial_(MessageSinkType& messageSink):
+        _messageSink(messageSink)
+    {
+        _packetSerial.setPacketHandler(&onPacketReceived, this);
+    }
+
+#if defined(ARDUINO)
+    /// \brief Begin a default serial connection with the given speed.
+    /// \param speed The serial data transmission speed in bits / second (baud).
+    /// \sa PacketSerial_::begin()
+    void begin(unsigned long speed)
+    {
+        _packetSerial.begin(speed);
+    }
+#endif
+
+    /// \brief Attach to an existing Arduino `Stream`.
+    /// \param stream A pointer to an Arduino `Stream`.
+    void setStream(Stream* stream)
+    {
+        _packetSerial.setStream(stream);
+    }
+
+    /// \brief Get the PacketSerial_ that sends the fragments.
+    ///
+    /// Its packet handler is used to receive fragments and must not be
+    /// changed.
+    ///
+    /// \returns the PacketSerial_ instance.
+    PacketSerialType& getPacketSerial()
+    {
+        return _packetSerial;
+    }
+
+    /// \brief Service the serial connection.
+    /// \sa PacketSerial_::update()
+    void update()
+    {
+        _packetSerial.update();
+    }
+
+    /// \brief Send a message as a series of fragments.
+    ///
+    /// The fragments are sent directly from the \p buffer, so no memory is
+    /// needed to send a message of any size.
+    ///
+    /// \param buffer A pointer to the message.
+    /// \param size The number of bytes in the message.
+    void send(const uint8_t* buffer, uint32_t size)
+    {
+        if (buffer == nullptr && size > 0) return;
+
+        uint8_t message = _sendMessage++ & MessageMask;
+        uint8_t fragment = 0;
+        uint32_t offset = 0;
+
+        do
+        {
+            uint32_t remaining = size - offset;
+            size_t fragmentSize = remaining < FragmentSize ? remaining : FragmentSize;
+
+            uint8_t header[FirstHeaderSize];
+            size_t headerSize = HeaderSize;
+
+            header[0] = message;
+            header[1] = fragment++;
+
+            if (offset == 0)
+            {
+                header[0] |= First;
+                header[2] = static_cast<uint8_t>(size);
+                header[3] = static_cast<uint8_t>(size >> 8);
+                header[4] = static_cast<uint8_t>(size >> 16);
+                header[5] = static_cast<uint8_t>(size >> 24);
+                headerSize = FirstHeaderSize;
+            }
+
+            if (offset + fragmentSize == size)
+                header[0] |= Last;
+
+            const PacketSegment segments[2] = {
+                { header, headerSize },
+                { buffer + offset, fragmentSize }
+            };
+
+            _packetSerial.send(segments, 2);
+            offset += fragmentSize;
+        }
+        while (offset < size);
+    }
+
+    /// \returns the number of received messages that were aborted because a
+    ///          fragment was lost or the message sink failed.
+    uint32_t dropped() const
+    {
+        return _dropped;
+    }
+
+private:
+    FragmentedPacketSerial_(const FragmentedPacketSerial_&);
+    FragmentedPacketSerial_& operator = (const FragmentedPacketSerial_&);
+
+    enum
+    {
+        First = 0x80,
+        Last = 0x40,
+        MessageMask = 0x3F
+    };
+
+    static void onPacketReceived(const void* sender, const uint8_t* buffer, size_t size)
+    {
+        static_cast<FragmentedPacketSerial_*>(const_cast<void*>(sender))->receive(buffer, size);
+    }
+
+    void receive(const uint8_t* buffer, size_t size)
+    {
+        // Empty packets, e.g. from repeated packet markers, are ignored.
+        if (size == 0)
+            return;
+
+        if (size < HeaderSize)
+        {
+            abort();
+            return;
+        }
+
+        uint8_t flags = buffer[0];
+
+        if (flags & First)
+        {
+            // A new message aborts one that was not finished.
+            abort();
+
+            if (size < FirstHeaderSize)
+                return;
+
+            _receiveSize = buffer[2]
+                         | (static_cast<uint32_t>(buffer[3]) << 8)
+                         | (static_cast<uint32_t>(buffer[4]) << 16)
+                         | (static_cast<uint32_t>(buffer[5]) << 24);
+
+            if (buffer[1] != 0 || !_messageSink.begin(_receiveSize))
+                return;
+
+            _receiving = true;
+            _receiveMessage = flags & MessageMask;
+            _receiveFragment = 0;
+            _receiveOffset = 0;
+
+            buffer += FirstHeaderSize;
+            size -= FirstHeaderSize;
+        }
+        else
+        {
+            if (!_receiving)
+                return;
+
+            if ((flags & MessageMask) != _receiveMessage ||
+                buffer[1] != _receiveFragment)
+            {
+                abort();
+                return;
+            }
+
+            buffer += HeaderSize;
+            size -= HeaderSize;
+        }
+
+        _receiveFragment++;
+
+        bool last = (flags & Last) != 0;
+
+        if (size > _receiveSize - _receiveOffset ||
+            last != (_receiveOffset + size == _receiveSize) ||
+            (size > 0 && !_messageSink.write(buffer, size)))
+        {
+            abort();
+            return;
+        }
+
+        _receiveOffset += size;
+
+        if (last)
+        {
+            _receiving = false;
+            _messageSink.end(true);
+        }
+    }
+
+    void abort()
+    {
+        if (_receiving)
+        {
+            _receiving = false;
+            _dropped++;
+            _messageSink.end(false);
+        }
+    }
+
+    PacketSerialType _packetSerial;
+
+    MessageSinkType& _messageSink;
+
+    uint8_t _sendMessage = 0;
+
+    bool _receiving = false;
+    uint8_t _receiveMessage = 0;
+    uint8_t _receiveFragment = 0;
+    uint32_t _receiveSize = 0;
+    uint32_t _receiveOffset = 0;
+
+    uint32_t _dropped = 0;
+};
+
+
+/// \brief A FragmentedPacketSerial_ over a default COBS PacketSerial.
+template<typename MessageSinkType>
+using FragmentedPacketSerial = FragmentedPacketSerial_<MessageSinkType>;
@@ -0,0 +1,424 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include <Arduino.h>
+
+
+#if !defined(__unix__) && !defined(__APPLE__)
+    #error "FileDescriptorStream requires a POSIX host."
+#endif
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+/// \brief A `Stream` that reads from and writes to POSIX file descriptors.
+///
+/// This lets PacketSerial_ run on a Linux or macOS host and talk to a board
+/// over a serial device, or to another process over a pseudo terminal or a
+/// pair of pipes:
+///
+///     PacketSerial myPacketSerial;
+///     FileDescriptorStream myStream;
+///
+///     int main()
+///     {
+///         if (!myStream.open("/dev/ttyACM0", 115200))
+///             return 1;
+///
+///         myPacketSerial.setStream(&myStream);
+///         myPacketSerial.setPacketHandler(&onPacketReceived);
+///
+///         while (true)
+///         {
+///             // Sleep until bytes arrive, sending any queued bytes.
+///             myStream.wait(100);
+///             myPacketSerial.update();
+///         }
+///     }
+///
+/// The file descriptors are non-blocking. Bytes are read with one `read()`
+/// call per `ReceiveBufferSize` bytes, so `update()` mostly reads from memory.
+/// Written bytes are queued in a transmit buffer and sent by `flush()`,
+/// `wait()` or when the buffer is full, when the queued bytes and the new
+/// bytes are sent together with one `writev()` call.
+///
+/// To integrate with an existing event loop (e.g. `epoll`), watch
+/// `getReadFileDescriptor()` for input, call `update()` when it is readable
+/// and call `flush()` after sending.
+///
+/// \tparam ReceiveBufferSize The number of bytes read at once.
+/// \tparam TransmitBufferSize The number of bytes queued before writing.
+template<size_t ReceiveBufferSize = 4096, size_t TransmitBufferSize = 4096>
+class FileDescriptorStream_: public Stream
+{
+public:
+    /// \brief Construct a FileDescriptorStream_ without file descriptors.
+    FileDescriptorStream_()
+    {
+    }
+
+    /// \brief Construct a FileDescriptorStream_ for a file descriptor.
+    ///
+    /// The file descriptor is not closed by the stream.
+    ///
+    /// \param fd A file descriptor that is open for reading and writing.
+    explicit FileDescriptorStream_(int fd)
+    {
+        setFileDescriptors(fd, fd);
+    }
+
+    /// \brief Construct a FileDescriptorStream_ for a pair of file descriptors.
+    ///
+    /// The file descriptors are not closed by the stream.
+    ///
+    /// \param readFd A file descriptor that is open for reading.
+    /// \param writeFd A file descriptor that is open for writing.
+    FileDescriptorStream_(int readFd, int writeFd)
+    {
+        setFileDescriptors(readFd, writeFd);
+    }
+
+    /// \brief Destroy the FileDescriptorStream_, closing an opened device.
+    ~FileDescriptorStream_()
+    {
+        close();
+    }
+
+    /// \brief Open and configure a serial device.
+    ///
+    /// The device is set to raw mode with 8 data bits, no parity, one stop bit
+    /// and no flow control.
+    ///
+    /// \param path The path of the device, e.g. `/dev/ttyUSB0`.
+    /// \param speed The serial data transmission speed in bits / second (baud).
+    /// \returns true if the device was opened and configured, otherwise
+    ///          false with `errno` set.
+    bool open(const char* path, unsigned long speed)
+    {
+        close();
+
+        int fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+        if (fd < 0)
+            return false;
+
+        if (!configure(fd, speed))
+        {
+            int error = errno;
+            ::close(fd);
+            errno = error;
+            return false;
+        }
+
+        setFileDescriptors(fd, fd);
+        _ownsFileDescriptors = true;
+        return true;
+    }
+
+    /// \brief Close a device opened with open().
+    ///
+    /// Queued bytes are sent first. File descriptors passed to the
+    /// constructor or to setFileDescriptors() are not closed.
+    void close()
+    {
+        flush();
+
+        if (_ownsFileDescriptors)
+        {
+            ::close(_readFd);
+        }
+
+        _readFd = -1;
+        _writeFd = -1;
+        _ownsFileDescriptors = false;
+        _receiveIndex = 0;
+        _receiveSize = 0;
+        _transmitSize = 0;
+    }
+
+    /// \brief Use existing file descriptors, e.g. of a pseudo terminal or pipes.
+    ///
+    /// The file descriptors are made non-blocking and are not closed by the
+    /// stream.
+    ///
+    /// \param readFd A file descriptor that is open for reading.
+    /// \param writeFd A file descriptor that is open for writing.
+    void setFileDescriptors(int readFd, int writeFd)
+    {
+        _readFd = readFd;
+        _writeFd = writeFd;
+        setNonBlocking(_readFd);
+        setNonBlocking(_writeFd);
+    }
+
+    /// \returns the file descriptor that is read from, or -1 if unset.
+    int getReadFileDescriptor() const
+    {
+        return _readFd;
+    }
+
+    /// \returns the file descriptor that is written to, or -1 if unset.
+    int getWriteFileDescriptor() const
+    {
+        return _writeFd;
+    }
+
+    /// \brief Wait until bytes can be read, sending queued bytes meanwhile.
+    /// \param timeout The maximum time to wait in milliseconds, or -1 to wait
+    ///        indefinitely.
+    /// \returns true if bytes can be read.
+    bool wait(int timeout)
+    {
+        if (_receiveIndex < _receiveSize)
+            return true;
+
+        pollfd fds[2] = {
+            { _readFd, POLLIN, 0 },
+            { _writeFd, POLLOUT, 0 }
+        };
+
+        nfds_t count = _transmitSize > 0 ? 2 : 1;
+
+        if (poll(fds, count, timeout) <= 0)
+            return false;
+
+        if (count == 2 && (fds[1].revents & POLLOUT))
+            transmit();
+
+        return (fds[0].revents & (POLLIN | POLLHUP)) != 0;
+    }
+
+    int available() override
+    {
+        if (_receiveIndex == _receiveSize)
+            receive();
+
+        return static_cast<int>(_receiveSize - _receiveIndex);
+    }
+
+    int read() override
+    {
+        if (available() == 0)
+            return -1;
+
+        return _receiveBuffer[_receiveIndex++];
+    }
+
+    int peek() override
+    {
+        if (available() == 0)
+            return -1;
+
+        return _receiveBuffer[_receiveIndex];
+    }
+
+    size_t write(uint8_t data) override
+    {
+        return write(&data, 1);
+    }
+
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        if (_writeFd < 0)
+            return 0;
+
+        if (size <= TransmitBufferSize - _transmitSize)
+        {
+            memcpy(_transmitBuffer + _transmitSize, buffer, size);
+            _transmitSize += size;
+            return size;
+        }
+
+        // Send the queued bytes and the new bytes with one system call.
+        iovec iov[2] = {
+            { _transmitBuffer, _transmitSize },
+            { const_cast<uint8_t*>(buffer), size }
+        };
+
+        _transmitSize = 0;
+        return writeAll(iov, 2) ? size : 0;
+    }
+
+    int availableForWrite() override
+    {
+        return static_cast<int>(TransmitBufferSize - _transmitSize);
+    }
+
+    /// \brief Send all queued bytes, waiting until they are written.
+    void flush() override
+    {
+        if (_transmitSize == 0)
+            return;
+
+        iovec iov = { _transmitBuffer, _transmitSize };
+        _transmitSize = 0;
+        writeAll(&iov, 1);
+    }
+
+private:
+    FileDescriptorStream_(const FileDescriptorStream_&);
+    FileDescriptorStream_& operator = (const FileDescriptorStream_&);
+
+    static void setNonBlocking(int fd)
+    {
+        if (fd < 0)
+            return;
+
+        int flags = fcntl(fd, F_GETFL, 0);
+
+        if (flags >= 0)
+            fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    static bool configure(int fd, unsigned long speed)
+    {
+        termios options;
+
+        if (tcgetattr(fd, &options) != 0)
+            return false;
+
+        cfmakeraw(&options);
+        options.c_cflag |= CLOCAL | CREAD;
+        options.c_cflag &= ~(CSTOPB | PARENB);
+#if defined(CRTSCTS)
+        options.c_cflag &= ~CRTSCTS;
+#endif
+        options.c_cc[VMIN] = 0;
+        options.c_cc[VTIME] = 0;
+
+        speed_t baud = toSpeed(speed);
+
+        if (baud == 0 || cfsetispeed(&options, baud) != 0 || cfsetospeed(&options, baud) != 0)
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        return tcsetattr(fd, TCSANOW, &options) == 0;
+    }
+
+    static speed_t toSpeed(unsigned long speed)
+    {
+        switch (speed)
+        {
+            case 9600: return B9600;
+            case 19200: return B19200;
+            case 38400: return B38400;
+            case 57600: return B57600;
+            case 115200: return B115200;
+            case 230400: return B230400;
+#if defined(B460800)
+            case 460800: return B460800;
+#endif
+#if defined(B921600)
+            case 921600: return B921600;
+#endif
+#if defined(B1000000)
+            case 1000000: return B1000000;
+#endif
+#if defined(B2000000)
+            case 2000000: return B2000000;
+#endif
+#if defined(B3000000)
+            case 3000000: return B3000000;
+#endif
+#if defined(B4000000)
+            case 4000000: return B4000000;
+#endif
+            default: return 0;
+        }
+    }
+
+    void receive()
+    {
+        _receiveIndex = 0;
+        _receiveSize = 0;
+
+        if (_readFd < 0)
+            return;
+
+        ssize_t count = ::read(_readFd, _receiveBuffer, ReceiveBufferSize);
+
+        if (count > 0)
+            _receiveSize = static_cast<size_t>(count);
+    }
+
+    // Write as many queued bytes as possible without waiting.
+    void transmit()
+    {
+        ssize_t count = ::write(_writeFd, _transmitBuffer, _transmitSize);
+
+        if (count > 0)
+        {
+            _transmitSize -= static_cast<size_t>(count);
+            memmove(_transmitBuffer, _transmitBuffer + count, _transmitSize);
+        }
+    }
+
+    // Write all bytes, waiting whenever the file descriptor is not writable.
+    bool writeAll(iovec* iov, int count)
+    {
+        while (count > 0)
+        {
+            ssize_t written = writev(_writeFd, iov, count);
+
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    return false;
+
+                pollfd fd = { _writeFd, POLLOUT, 0 };
+                poll(&fd, 1, -1);
+                continue;
+            }
+
+            size_t remaining = static_cast<size_t>(written);
+
+            while (count > 0 && remaining >= iov->iov_len)
+            {
+                remaining -= iov->iov_len;
+                iov++;
+                count--;
+            }
+
+            if (count > 0)
+            {
+                iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + remaining;
+                iov->iov_len -= remaining;
+            }
+        }
+
+        return true;
+    }
+
+    int _readFd = -1;
+    int _writeFd = -1;
+    bool _ownsFileDescriptors = false;
+
+    uint8_t _receiveBuffer[ReceiveBufferSize];
+    size_t _receiveIndex = 0;
+    size_t _receiveSize = 0;
+
+    uint8_t _transmitBuffer[TransmitBufferSize];
+    size_t _transmitSize = 0;
+};
+
+
+/// \brief A FileDescriptorStream_ with 4 KiB receive and transmit buffers.
+typedef FileDescriptorStream_<> FileDescriptorStream;
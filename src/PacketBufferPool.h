@@ -0,0 +1,272 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include <Arduino.h>
+
+
+/// \brief A fixed-size scratch buffer that takes no space when Size is 0.
+template<size_t Size>
+struct PacketScratchBuffer
+{
+    uint8_t data[Size];
+};
+
+
+template<>
+struct PacketScratchBuffer<0>
+{
+};
+
+
+/// \brief A fixed number of fixed-size blocks shared by several PacketSerial_
+///        instances.
+///
+/// By default each PacketSerial_ has its own receive buffer, sized for the
+/// largest packet, although most ports are idle between packets. With a
+/// buffer pool, a port borrows a block when the first byte of a packet
+/// arrives and returns it once the packet has been passed to the packet
+/// handler. A port with a transmit buffer borrows a block while packets are
+/// queued. So the pool only needs as many blocks as ports that are in the
+/// middle of a packet at the same time:
+///
+///     PacketBufferPool_<256, 3> myBufferPool;
+///
+///     PooledPacketSerial<PacketBufferPool_<256, 3> > myPacketSerials[8];
+///
+///     void setup()
+///     {
+///         for (size_t i = 0; i < 8; i++)
+///         {
+///             myPacketSerials[i].setBufferPool(&myBufferPool);
+///         }
+///     }
+///
+/// When no block is free, the packet that needed it is dropped. Use
+/// `getExhaustedCount()` and `getMinAvailableBlocks()` to size the pool.
+///
+/// The free blocks are kept in a list threaded through the blocks
+/// themselves, so the pool uses no memory besides the blocks and
+/// `acquire()` and `release()` take constant time. They must not be called
+/// from an interrupt while they may also run in the main loop.
+///
+/// \tparam BlockSize The number of bytes in each block.
+/// \tparam BlockCount The number of blocks, from 1 to 255.
+template<size_t BlockSize, size_t BlockCount>
+class PacketBufferPool_
+{
+public:
+    static_assert(BlockSize > 0, "BlockSize must be greater than 0.");
+    static_assert(BlockCount > 0 && BlockCount < 256, "BlockCount must be from 1 to 255.");
+
+    enum
+    {
+        /// \brief The number of bytes in each block.
+        Size = BlockSize,
+
+        /// \brief The number of blocks.
+        Count = BlockCount
+    };
+
+    /// \brief Construct a pool with all blocks free.
+    PacketBufferPool_()
+    {
+        for (size_t i = 0; i < BlockCount; i++)
+        {
+            _blocks[i][0] = static_cast<uint8_t>(i + 1 < BlockCount ? i + 1 : static_cast<size_t>(NoBlock));
+        }
+    }
+
+    /// \brief Borrow a block.
+    /// \returns a pointer to `BlockSize` bytes, or nullptr if no block is free.
+    uint8_t* acquire()
+    {
+        if (_free == NoBlock)
+        {
+            _exhaustedCount++;
+            return nullptr;
+        }
+
+        uint8_t* block = _blocks[_free];
+        _free = block[0];
+
+        if (--_availableBlocks < _minAvailableBlocks)
+            _minAvailableBlocks = _availableBlocks;
+
+        return block;
+    }
+
+    /// \brief Return a block.
+    /// \param block A pointer returned by `acquire()`, or nullptr.
+    void release(uint8_t* block)
+    {
+        if (block == nullptr) return;
+
+        block[0] = _free;
+        _free = static_cast<uint8_t>((block - _blocks[0]) / BlockSize);
+        _availableBlocks++;
+    }
+
+    /// \returns the number of free blocks.
+    size_t getAvailableBlocks() const
+    {
+        return _availableBlocks;
+    }
+
+    /// \returns the smallest number of free blocks since the last reset.
+    size_t getMinAvailableBlocks() const
+    {
+        return _minAvailableBlocks;
+    }
+
+    /// \brief Reset getMinAvailableBlocks() to the number of free blocks.
+    void resetMinAvailableBlocks()
+    {
+        _minAvailableBlocks = _availableBlocks;
+    }
+
+    /// \returns the number of times `acquire()` found no free block.
+    uint32_t getExhaustedCount() const
+    {
+        return _exhaustedCount;
+    }
+
+private:
+    PacketBufferPool_(const PacketBufferPool_&);
+    PacketBufferPool_& operator = (const PacketBufferPool_&);
+
+    enum
+    {
+        NoBlock = 0xFF
+    };
+
+    uint8_t _blocks[BlockCount][BlockSize];
+
+    uint8_t _free = 0;
+    uint8_t _availableBlocks = BlockCount;
+    uint8_t _minAvailableBlocks = BlockCount;
+
+    uint32_t _exhaustedCount = 0;
+};
+
+
+/// \brief A buffer of `Size` bytes borrowed from a buffer pool.
+///
+/// The buffer is acquired with `acquire()` and returned with `release()`.
+/// `detach()` hands the block to the caller, e.g. while a packet handler
+/// uses it, so that a new block can be acquired in the meantime.
+///
+/// If `BufferPoolType` is void, the buffer is a member and is always
+/// available. See the specialization below.
+///
+/// \tparam Size The number of bytes needed.
+/// \tparam BufferPoolType The PacketBufferPool_ type, or void.
+template<size_t Size, typename BufferPoolType>
+class PacketPoolBuffer
+{
+public:
+    static_assert(Size <= BufferPoolType::Size, "The blocks of the BufferPoolType are too small.");
+
+    enum
+    {
+        IsPooled = 1
+    };
+
+    PacketPoolBuffer()
+    {
+    }
+
+    ~PacketPoolBuffer()
+    {
+        release();
+    }
+
+    void setPool(BufferPoolType* pool)
+    {
+        release();
+        _pool = pool;
+    }
+
+    /// \returns true if a block is held.
+    bool acquire()
+    {
+        if (_data == nullptr && _pool != nullptr)
+            _data = _pool->acquire();
+
+        return _data != nullptr;
+    }
+
+    void release()
+    {
+        release(detach());
+    }
+
+    void release(uint8_t* data)
+    {
+        if (_pool != nullptr)
+            _pool->release(data);
+    }
+
+    uint8_t* detach()
+    {
+        uint8_t* data = _data;
+        _data = nullptr;
+        return data;
+    }
+
+    uint8_t* data() const
+    {
+        return _data;
+    }
+
+private:
+    PacketPoolBuffer(const PacketPoolBuffer&);
+    PacketPoolBuffer& operator = (const PacketPoolBuffer&);
+
+    BufferPoolType* _pool = nullptr;
+    uint8_t* _data = nullptr;
+};
+
+
+/// \brief A member buffer of `Size` bytes.
+template<size_t Size>
+class PacketPoolBuffer<Size, void>
+{
+public:
+    enum
+    {
+        IsPooled = 0
+    };
+
+    bool acquire()
+    {
+        return true;
+    }
+
+    void release()
+    {
+    }
+
+    void release(uint8_t*)
+    {
+    }
+
+    uint8_t* detach()
+    {
+        return _buffer.data;
+    }
+
+    uint8_t* data()
+    {
+        return _buffer.data;
+    }
+
+private:
+    PacketScratchBuffer<Size> _buffer;
+};
@@ -0,0 +1,147 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include <Arduino.h>
+
+
+/// \brief A packet handler that calls a function known at compile time.
+///
+/// Unlike a function pointer passed to `setPacketHandler()`, the function is
+/// part of the type, so it takes no space and can be inlined into
+/// `PacketSerial_::update()`:
+///
+///     void onPacketReceived(const uint8_t* buffer, size_t size);
+///
+///     InlinePacketSerial<PacketFunctionHandler<&onPacketReceived> > myPacketSerial;
+///
+/// \tparam Function The function that receives decoded packets.
+template<void (*Function)(const uint8_t* buffer, size_t size)>
+class PacketFunctionHandler
+{
+public:
+    void operator () (const uint8_t* buffer, size_t size) const
+    {
+        Function(buffer, size);
+    }
+};
+
+
+/// \brief A packet handler that calls a member function of an object.
+///
+/// This replaces the static trampoline and `void*` sender pointer otherwise
+/// needed to receive packets in a class:
+///
+///     class EchoClass
+///     {
+///     public:
+///         EchoClass(): myPacketSerial(Handler(this))
+///         {
+///         }
+///
+///     private:
+///         void onPacketReceived(const uint8_t* buffer, size_t size);
+///
+///         typedef PacketMemberHandler<EchoClass, &EchoClass::onPacketReceived> Handler;
+///
+///         InlinePacketSerial<Handler> myPacketSerial;
+///     };
+///
+/// \tparam ClassType The class of the object.
+/// \tparam Method The member function that receives decoded packets.
+template<typename ClassType, void (ClassType::*Method)(const uint8_t* buffer, size_t size)>
+class PacketMemberHandler
+{
+public:
+    /// \brief Construct a PacketMemberHandler for an object.
+    /// \param object A pointer to the object that receives decoded packets.
+    explicit PacketMemberHandler(ClassType* object = nullptr):
+        _object(object)
+    {
+    }
+
+    void operator () (const uint8_t* buffer, size_t size) const
+    {
+        (_object->*Method)(buffer, size);
+    }
+
+private:
+    ClassType* _object;
+};
+
+
+/// \brief Removes references and `const` and `volatile` qualifiers from a type.
+///
+/// A minimal `std::decay` for class types, as the standard library is not
+/// available on every Arduino core.
+template<typename T> struct PacketHandlerDecay { typedef T Type; };
+template<typename T> struct PacketHandlerDecay<T&> { typedef typename PacketHandlerDecay<T>::Type Type; };
+template<typename T> struct PacketHandlerDecay<T&&> { typedef typename PacketHandlerDecay<T>::Type Type; };
+template<typename T> struct PacketHandlerDecay<const T> { typedef typename PacketHandlerDecay<T>::Type Type; };
+template<typename T> struct PacketHandlerDecay<volatile T> { typedef typename PacketHandlerDecay<T>::Type Type; };
+template<typename T> struct PacketHandlerDecay<const volatile T> { typedef typename PacketHandlerDecay<T>::Type Type; };
+
+
+/// \brief Defines `Type` if `Argument`, after PacketHandlerDecay, is not
+///        `Class`.
+///
+/// Used to keep forwarding constructors that take a packet handler from
+/// being chosen over the copy constructor of `Class`.
+template<typename Argument, typename Class, typename T = void>
+struct PacketHandlerEnableIfNot
+{
+    typedef T Type;
+};
+
+
+template<typename Class, typename T>
+struct PacketHandlerEnableIfNot<Class, Class, T>
+{
+};
+
+
+/// \brief Holds the packet handler of a PacketSerial_.
+///
+/// A packet handler type is any type that can be called like
+/// `void(const uint8_t* buffer, size_t size)`, e.g. a PacketFunctionHandler,
+/// a PacketMemberHandler, a function object or a lambda. The handler is
+/// stored by value, and is moved into place when it is passed as an rvalue.
+///
+/// \tparam PacketHandlerType The type of the packet handler.
+template<typename PacketHandlerType>
+struct PacketHandlerStorage
+{
+    PacketHandlerStorage():
+        handler()
+    {
+    }
+
+    template<typename HandlerType,
+             typename = typename PacketHandlerEnableIfNot<typename PacketHandlerDecay<HandlerType>::Type,
+                                                          PacketHandlerStorage>::Type>
+    explicit PacketHandlerStorage(HandlerType&& packetHandler):
+        handler(static_cast<HandlerType&&>(packetHandler))
+    {
+    }
+
+    PacketHandlerType handler;
+};
+
+
+/// \brief Holds the function pointers set with `PacketSerial_::setPacketHandler()`.
+template<>
+struct PacketHandlerStorage<void>
+{
+    typedef void (*PacketHandlerFunction)(const uint8_t* buffer, size_t size);
+    typedef void (*PacketHandlerFunctionWithSender)(const void* sender, const uint8_t* buffer, size_t size);
+
+    PacketHandlerFunction onPacketFunction = nullptr;
+    PacketHandlerFunctionWithSender onPacketFunctionWithSender = nullptr;
+    void* senderPtr = nullptr;
+};
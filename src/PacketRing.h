@@ -0,0 +1,126 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include <Arduino.h>
+
+
+/// \brief A fixed-capacity ring of packet slots.
+///
+/// Each slot holds one complete packet of up to `SlotSize` bytes. Packets are
+/// written directly into the slot returned by `writeBuffer()` and queued with
+/// `commit()`. Queued packets are read in place with `peek()` and returned to
+/// the ring with `release()`, so packets are never copied.
+///
+/// The ring is a lock-free single-producer / single-consumer queue. One
+/// context (e.g. a UART interrupt, a DMA callback or a thread) may call
+/// `writeBuffer()` and `commit()` while another calls `peek()` and `release()`.
+///
+/// \tparam SlotCount The number of slots. Must be a power of two <= 128.
+/// \tparam SlotSize The maximum number of bytes in each packet.
+template<uint8_t SlotCount, size_t SlotSize>
+class PacketRing_
+{
+public:
+    static_assert(SlotCount > 0 && SlotCount <= 128 && (SlotCount & (SlotCount - 1)) == 0,
+                  "SlotCount must be a power of two <= 128.");
+
+    /// \brief Get the number of queued packets.
+    uint8_t size() const
+    {
+        return static_cast<uint8_t>(load(_head) - load(_tail));
+    }
+
+    /// \returns true if no packets are queued.
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    /// \returns true if all slots hold queued packets.
+    bool full() const
+    {
+        return size() == SlotCount;
+    }
+
+    /// \brief Get the slot that the next packet should be written to.
+    /// \returns a pointer to `SlotSize` bytes, or nullptr if the ring is full.
+    uint8_t* writeBuffer()
+    {
+        return full() ? nullptr : _slots[_head % SlotCount];
+    }
+
+    /// \brief Queue the packet written to `writeBuffer()`.
+    /// \param size The number of bytes written to the slot.
+    void commit(size_t size)
+    {
+        _sizes[_head % SlotCount] = size;
+
+        // Publish the packet only after its size and bytes are written.
+        store(_head, static_cast<uint8_t>(_head + 1));
+    }
+
+    /// \brief Get the oldest queued packet without removing it.
+    /// \param buffer Set to a pointer to the packet's bytes.
+    /// \param size Set to the number of bytes in the packet.
+    /// \returns true if a packet was queued.
+    bool peek(const uint8_t*& buffer, size_t& size) const
+    {
+        if (empty())
+            return false;
+
+        buffer = _slots[_tail % SlotCount];
+        size = _sizes[_tail % SlotCount];
+        return true;
+    }
+
+    /// \brief Remove the oldest queued packet.
+    ///
+    /// The buffer returned by `peek()` must not be used after this call.
+    void release()
+    {
+        if (!empty())
+            store(_tail, static_cast<uint8_t>(_tail + 1));
+    }
+
+private:
+    // Single-core AVR and ESP8266 parts only need the compiler to keep the
+    // accesses in order, and 8-bit loads and stores are always atomic.
+    // Everywhere else the acquire / release ordering is enforced in hardware.
+    static uint8_t load(const uint8_t& counter)
+    {
+#if defined(__AVR__) || defined(ESP8266)
+        __asm__ __volatile__("" ::: "memory");
+        uint8_t value = *static_cast<const volatile uint8_t*>(&counter);
+        __asm__ __volatile__("" ::: "memory");
+        return value;
+#else
+        return __atomic_load_n(&counter, __ATOMIC_ACQUIRE);
+#endif
+    }
+
+    static void store(uint8_t& counter, uint8_t value)
+    {
+#if defined(__AVR__) || defined(ESP8266)
+        __asm__ __volatile__("" ::: "memory");
+        *static_cast<volatile uint8_t*>(&counter) = value;
+        __asm__ __volatile__("" ::: "memory");
+#else
+        __atomic_store_n(&counter, value, __ATOMIC_RELEASE);
+#endif
+    }
+
+    uint8_t _slots[SlotCount][SlotSize];
+    size_t _sizes[SlotCount];
+
+    // Free-running counters. Because SlotCount divides 256, the slot index is
+    // the counter modulo SlotCount even after the counters wrap.
+    uint8_t _head = 0;
+    uint8_t _tail = 0;
+};
@@ -0,0 +1,214 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include <Arduino.h>
+
+
+/// \brief Dispatches packets to handlers by message id.
+///
+/// The first byte of each packet is its message id, and the remaining bytes
+/// are its payload. Each message id has at most one route, which holds the
+/// handler for the id and the range of valid payload sizes. The routes are
+/// stored in a flat table indexed by the message id, so each packet is
+/// dispatched with one lookup instead of a `switch` over all ids.
+///
+/// Packets with an id that has no route, and packets whose payload size is
+/// outside the range of their route, are dropped before they reach a
+/// handler:
+///
+///     struct Position
+///     {
+///         LittleEndian<int16_t> x;
+///         LittleEndian<int16_t> y;
+///     };
+///
+///     void onPing(const uint8_t* payload, size_t size)
+///     {
+///         // size is 0.
+///     }
+///
+///     void onPosition(const uint8_t* payload, size_t size)
+///     {
+///         // size is sizeof(Position), so the cast always succeeds.
+///         const Position* position = packetCast<Position>(payload, size);
+///     }
+///
+///     PacketSerial myPacketSerial;
+///     PacketRouter myRouter;
+///
+///     void setup()
+///     {
+///         myRouter.setRoute(1, &onPing, 0, 0);
+///         myRouter.setRoute(2, &onPosition, sizeof(Position), sizeof(Position));
+///
+///         myPacketSerial.begin(115200);
+///         myPacketSerial.setPacketHandler(&PacketRouter::onPacketReceived, &myRouter);
+///     }
+///
+/// A PacketRouter_ can also be the handler of an InlinePacketSerial, in which
+/// case it is called directly:
+///
+///     InlinePacketSerial<PacketRouter&> myPacketSerial(myRouter);
+///
+/// Each route is a function pointer and two sizes, e.g. 6 bytes of RAM on
+/// AVR, so the table of the default PacketRouter, which covers the ids 0 to
+/// 15, takes 96 bytes there. A table for all 256 ids would take 1.5 KiB.
+///
+/// \tparam IdCount The number of message ids, from 0 to IdCount - 1. Each id
+///         takes one route in the table, so use the smallest count that
+///         covers all ids.
+template<size_t IdCount = 16>
+class PacketRouter_
+{
+public:
+    static_assert(IdCount > 0 && IdCount <= 256, "IdCount must be between 1 and 256.");
+
+    /// \brief A typedef describing the message handler method.
+    ///
+    /// The message handler method usually has the form:
+    ///
+    ///     void onMessageReceived(const uint8_t* payload, size_t size);
+    ///
+    /// where payload is a pointer to the bytes after the message id, and size
+    /// is the number of bytes in the payload.
+    typedef void (*MessageHandlerFunction)(const uint8_t* payload, size_t size);
+
+    /// \brief A typedef describing the handler of packets without a route.
+    ///
+    /// The handler receives the whole packet, including the message id.
+    typedef void (*PacketHandlerFunction)(const uint8_t* buffer, size_t size);
+
+    /// \brief Construct a PacketRouter_ without routes.
+    PacketRouter_()
+    {
+        for (size_t i = 0; i < IdCount; i++)
+        {
+            _routes[i].handler = nullptr;
+            _routes[i].minSize = 0;
+            _routes[i].maxSize = 0;
+        }
+    }
+
+    /// \brief Set the handler of a message id.
+    ///
+    /// Setting a route replaces the previous route of the message id.
+    ///
+    /// \param id The message id.
+    /// \param handler A pointer to the message handler function.
+    /// \param minSize The smallest valid payload size.
+    /// \param maxSize The largest valid payload size.
+    /// \returns false if the message id is not below `IdCount`.
+    bool setRoute(uint8_t id,
+                  MessageHandlerFunction handler,
+                  size_t minSize = 0,
+                  size_t maxSize = static_cast<size_t>(-1))
+    {
+        if (id >= IdCount)
+            return false;
+
+        _routes[id].handler = handler;
+        _routes[id].minSize = minSize;
+        _routes[id].maxSize = maxSize;
+        return true;
+    }
+
+    /// \brief Remove the route of a message id.
+    /// \param id The message id.
+    void removeRoute(uint8_t id)
+    {
+        if (id < IdCount)
+            _routes[id].handler = nullptr;
+    }
+
+    /// \brief Set the function that receives packets whose id has no route.
+    ///
+    /// By default these packets are dropped. Packets whose payload size is
+    /// invalid are always dropped.
+    ///
+    /// \param onPacketFunction A pointer to the packet handler function.
+    void setUnroutedHandler(PacketHandlerFunction onPacketFunction)
+    {
+        _onUnroutedFunction = onPacketFunction;
+    }
+
+    /// \returns the number of packets dropped because they had no route or
+    ///          had an invalid payload size.
+    uint32_t dropped() const
+    {
+        return _dropped;
+    }
+
+    /// \brief Dispatch a packet to the handler of its message id.
+    /// \param buffer A pointer to the packet.
+    /// \param size The number of bytes in the packet.
+    void operator () (const uint8_t* buffer, size_t size)
+    {
+        // Empty packets, e.g. from repeated packet markers, are ignored.
+        if (size == 0)
+            return;
+
+        uint8_t id = buffer[0];
+
+        if (id >= IdCount || _routes[id].handler == nullptr)
+        {
+            if (_onUnroutedFunction)
+                _onUnroutedFunction(buffer, size);
+            else
+                _dropped++;
+
+            return;
+        }
+
+        const Route& route = _routes[id];
+
+        if (size - 1 < route.minSize || size - 1 > route.maxSize)
+        {
+            _dropped++;
+            return;
+        }
+
+        route.handler(buffer + 1, size - 1);
+    }
+
+    /// \brief A packet handler that dispatches packets to a router.
+    ///
+    /// Register it with the router as the sender pointer:
+    ///
+    ///     myPacketSerial.setPacketHandler(&PacketRouter::onPacketReceived, &myRouter);
+    ///
+    /// \param sender A pointer to the PacketRouter_.
+    /// \param buffer A pointer to the packet.
+    /// \param size The number of bytes in the packet.
+    static void onPacketReceived(const void* sender, const uint8_t* buffer, size_t size)
+    {
+        (*const_cast<PacketRouter_*>(static_cast<const PacketRouter_*>(sender)))(buffer, size);
+    }
+
+private:
+    PacketRouter_(const PacketRouter_&);
+    PacketRouter_& operator = (const PacketRouter_&);
+
+    struct Route
+    {
+        MessageHandlerFunction handler;
+        size_t minSize;
+        size_t maxSize;
+    };
+
+    Route _routes[IdCount];
+
+    PacketHandlerFunction _onUnroutedFunction = nullptr;
+
+    uint32_t _dropped = 0;
+};
+
+
+/// \brief A PacketRouter_ for the message ids 0 to 15.
+typedef PacketRouter_<> PacketRouter;
@@ -9,8 +9,201 @@
 
 
 #include <Arduino.h>
+#include "Encoding/ByteSearch.h"
+#include "Encoding/CheckedEncoder.h"
 #include "Encoding/COBS.h"
+#include "Encoding/CRC.h"
 #include "Encoding/SLIP.h"
+#include "PacketBufferPool.h"
+#include "PacketHandler.h"
+#include "PacketTransmitQueue.h"
+#include "TypedPacket.h"
+
+
+/// \brief The number of bytes PacketSerial_::update() reads from the stream at once.
+///
+/// By default `update()` reads one byte at a time with `Stream::read()`. If
+/// `PACKETSERIAL_READ_CHUNK_SIZE` is defined as a positive number before
+/// including PacketSerial.h, `update()` instead reads up to that many bytes
+/// at a time with `Stream::readBytes()` into a stack buffer and copies the
+/// bytes between packet markers in bulk. This is faster on cores whose
+/// `Stream` implementation provides a bulk `readBytes()`.
+#ifndef PACKETSERIAL_READ_CHUNK_SIZE
+    #define PACKETSERIAL_READ_CHUNK_SIZE 0
+#endif
+
+
+/// \brief Enables PacketSerial_::getStatistics().
+///
+/// If `PACKETSERIAL_ENABLE_STATISTICS` is defined as `1` before including
+/// PacketSerial.h, each PacketSerial_ instance counts the bytes and packets
+/// it sends and receives, and measures `update()` and its packet handler with
+/// `micros()`. By default statistics are disabled and cost nothing.
+#ifndef PACKETSERIAL_ENABLE_STATISTICS
+    #define PACKETSERIAL_ENABLE_STATISTICS 0
+#endif
+
+
+/// \brief Counters collected by a PacketSerial_ instance.
+///
+/// \sa PACKETSERIAL_ENABLE_STATISTICS
+struct PacketSerialStatistics
+{
+    /// \brief The number of encoded bytes read from the stream, including markers.
+    uint32_t bytesReceived = 0;
+
+    /// \brief The number of encoded bytes written to the stream, including markers.
+    uint32_t bytesSent = 0;
+
+    /// \brief The number of packets passed to the packet handler.
+    uint32_t packetsReceived = 0;
+
+    /// \brief The number of packets written to the stream.
+    uint32_t packetsSent = 0;
+
+    /// \brief The number of packets that `trySend()` could not queue.
+    uint32_t sendsRejected = 0;
+
+    /// \brief The number of `Stream::write()` calls that wrote queued bytes.
+    uint32_t batchesSent = 0;
+
+    /// \brief The number of packets that overflowed the receive buffer.
+    uint32_t overflows = 0;
+
+    /// \brief The number of packets that failed to decode.
+    uint32_t decodeErrors = 0;
+
+    /// \brief The number of packets dropped because no block of the buffer
+    ///        pool was free.
+    uint32_t poolExhausted = 0;
+
+    /// \brief The size of the largest decoded packet received.
+    size_t maxPacketSize = 0;
+
+    /// \brief The longest call to `update()`, in microseconds.
+    uint32_t maxUpdateMicros = 0;
+
+    /// \brief The longest call to the packet handler, in microseconds.
+    uint32_t maxHandlerMicros = 0;
+
+    /// \brief Reset all counters to zero.
+    void reset()
+    {
+        *this = PacketSerialStatistics();
+    }
+};
+
+
+/// \brief A tag type used to select an implementation at compile time.
+template<bool Value>
+struct EncoderFeature
+{
+};
+
+
+/// \brief Selects the incremental decoder type of a packet encoder.
+///
+/// Encoders without a `StreamDecoder` get an empty placeholder type.
+template<typename EncoderType, bool HasStreamDecoder>
+struct EncoderStreamDecoder
+{
+    typedef typename EncoderType::StreamDecoder Type;
+};
+
+
+template<typename EncoderType>
+struct EncoderStreamDecoder<EncoderType, false>
+{
+    typedef EncoderFeature<false> Type;
+};
+
+
+/// \brief Matches an encoder's `tryDecode()` function in EncoderTraits.
+template<bool (*)(const uint8_t*, size_t, uint8_t*, size_t&)>
+struct EncoderTryDecode
+{
+};
+
+
+/// \brief Compile-time information about a packet encoder.
+///
+/// Encoders that define a nested `StreamDecoder` class (e.g. `COBS` and
+/// `SLIP`) are decoded in place as each byte arrives. All other encoders are
+/// buffered and decoded when the packet marker arrives.
+///
+/// Buffered encoders that define a `tryDecode()` function drop packets that
+/// fail to decode. Without it, an invalid packet cannot be told apart from an
+/// empty one, so it is passed to the packet handler as returned by
+/// `decode()`.
+///
+/// Encoders that define a nested `StreamEncoder` class are encoded directly
+/// to the `Stream`. All other encoders are encoded into a temporary buffer.
+///
+/// \tparam EncoderType The static packet encoder class name.
+template<typename EncoderType>
+class EncoderTraits
+{
+private:
+    template<typename T> static char testStreamDecoder(typename T::StreamDecoder*);
+    template<typename T> static long testStreamDecoder(...);
+
+    template<typename T> static char testStreamEncoder(typename T::StreamEncoder*);
+    template<typename T> static long testStreamEncoder(...);
+
+    template<typename T> static char testTryDecode(EncoderTryDecode<&T::tryDecode>*);
+    template<typename T> static long testTryDecode(...);
+
+public:
+    enum
+    {
+        /// \brief True if the encoder provides an incremental decoder.
+        HasStreamDecoder = sizeof(testStreamDecoder<EncoderType>(nullptr)) == sizeof(char),
+
+        /// \brief True if the encoder provides an incremental encoder.
+        HasStreamEncoder = sizeof(testStreamEncoder<EncoderType>(nullptr)) == sizeof(char),
+
+        /// \brief True if the encoder reports invalid packets with tryDecode().
+        HasTryDecode = sizeof(testTryDecode<EncoderType>(nullptr)) == sizeof(char)
+    };
+
+    /// \brief The tag type used to select the receive implementation.
+    typedef EncoderFeature<HasStreamDecoder> StreamDecoderTag;
+
+    /// \brief The tag type used to select the send implementation.
+    typedef EncoderFeature<HasStreamEncoder> StreamEncoderTag;
+
+    /// \brief The tag type used to select the buffered decode implementation.
+    typedef EncoderFeature<HasTryDecode> TryDecodeTag;
+
+    /// \brief The incremental decoder type, if available.
+    typedef typename EncoderStreamDecoder<EncoderType, HasStreamDecoder>::Type StreamDecoder;
+
+    /// \brief Get the largest packet that fits a PacketSerial_ receive buffer.
+    ///
+    /// With a `StreamDecoder` the receive buffer holds decoded bytes.
+    /// Otherwise it holds the encoded bytes and one byte is kept free.
+    ///
+    /// \param receiveBufferSize The size of the receive buffer.
+    /// \returns the maximum size of a decoded packet.
+    static constexpr size_t getMaxPacketSize(size_t receiveBufferSize)
+    {
+        return HasStreamDecoder ? receiveBufferSize :
+               receiveBufferSize == 0 ? 0 :
+               EncoderType::getMaxDecodedSize(receiveBufferSize - 1);
+    }
+
+    /// \brief Get the smallest PacketSerial_ receive buffer for a packet size.
+    ///
+    /// This is the inverse of getMaxPacketSize().
+    ///
+    /// \param maxPacketSize The maximum size of a decoded packet.
+    /// \returns the minimum size of the receive buffer.
+    static constexpr size_t getMinReceiveBufferSize(size_t maxPacketSize)
+    {
+        return HasStreamDecoder ? maxPacketSize :
+               EncoderType::getEncodedBufferSize(maxPacketSize) + 1;
+    }
+};
 
 
 /// \brief A template class enabling packet-based Serial communication.
@@ -19,15 +212,56 @@
 /// `COBSPacketSerial` or `SLIPPacketSerial`.
 ///
 /// The template parameters allow the user to define their own packet encoder /
-/// decoder, custom packet marker and receive buffer size.
+/// decoder, custom packet marker, receive buffer size and maximum packet size.
+///
+/// All buffers are members whose sizes are computed at compile time from the
+/// template parameters, so the RAM used by an instance is `sizeof()` the
+/// instance and `send()` and `update()` use a small, fixed amount of stack.
+/// If `BufferPoolType` is set, the receive, decode and transmit buffers are
+/// instead borrowed from a PacketBufferPool_ shared with other instances
+/// while they are in use. See `setBufferPool()` and PooledPacketSerial.
+///
+/// If `TransmitBufferSize` is not 0, encoded packets are queued in a transmit
+/// buffer and written to the stream by `update()` without blocking. See
+/// `trySend()`.
+///
+/// By default the packet handler is a function pointer set with
+/// `setPacketHandler()`. If `PacketHandlerType` is set, the packet handler is
+/// an object of that type passed to the constructor, and is called directly
+/// so that the compiler can inline it. See InlinePacketSerial.
 ///
 /// \tparam EncoderType The static packet encoder class name.
 /// \tparam PacketMarker The byte value used to mark the packet boundary.
 /// \tparam BufferSize The number of bytes allocated for the receive buffer.
-template<typename EncoderType, uint8_t PacketMarker = 0, size_t ReceiveBufferSize = 256>
+/// \tparam MaxPacketSize The maximum number of decoded bytes in a packet. By
+///         default, the largest packet that fits the receive buffer.
+/// \tparam TransmitBufferSize The number of bytes allocated for queued
+///         encoded packets, or 0 to write every packet immediately.
+/// \tparam PacketHandlerType The type of the packet handler, or void to use
+///         function pointers set with setPacketHandler().
+/// \tparam BufferPoolType The PacketBufferPool_ type that provides the
+///         buffers, or void to make the buffers members.
+template<typename EncoderType,
+         uint8_t PacketMarker = 0,
+         size_t ReceiveBufferSize = 256,
+         size_t MaxPacketSize = EncoderTraits<EncoderType>::getMaxPacketSize(ReceiveBufferSize),
+         size_t TransmitBufferSize = 0,
+         typename PacketHandlerType = void,
+         typename BufferPoolType = void>
 class PacketSerial_
 {
 public:
+    static_assert(ReceiveBufferSize >= EncoderTraits<EncoderType>::getMinReceiveBufferSize(MaxPacketSize),
+                  "ReceiveBufferSize is too small for the encoded MaxPacketSize.");
+
+    enum
+    {
+        /// \brief The maximum number of decoded bytes in a packet.
+        ///
+        /// Layers that wrap a PacketSerial_ type check this at compile time.
+        MaxDecodedSize = MaxPacketSize
+    };
+
     /// \brief A typedef describing the packet handler method.
     ///
     /// The packet handler method usually has the form:
@@ -49,13 +283,35 @@ public:
     /// is the number of bytes in the incoming buffer.
     typedef void (*PacketHandlerFunctionWithSender)(const void* sender, const uint8_t* buffer, size_t size);
 
+    /// \brief A typedef describing the overflow handler method.
+    ///
+    /// The overflow handler method usually has the form:
+    ///
+    ///     void onOverflow(const void* sender);
+    ///
+    /// where sender is the pointer passed to `setOverflowHandler()`.
+    typedef void (*OverflowHandlerFunction)(const void* sender);
+
     /// \brief Construct a default PacketSerial_ device.
     PacketSerial_():
+        _receiveBufferIndex(0),
+        _stream(nullptr)
+    {
+    }
+
+    /// \brief Construct a PacketSerial_ device with a packet handler.
+    ///
+    /// This constructor is only available if `PacketHandlerType` is set.
+    ///
+    /// \param packetHandler The packet handler, which is copied, or moved if
+    ///        it is an rvalue, unless `PacketHandlerType` is a reference type.
+    template<typename HandlerType,
+             typename = typename PacketHandlerEnableIfNot<typename PacketHandlerDecay<HandlerType>::Type,
+                                                          PacketSerial_>::Type>
+    explicit PacketSerial_(HandlerType&& packetHandler):
         _receiveBufferIndex(0),
         _stream(nullptr),
-        _onPacketFunction(nullptr),
-        _onPacketFunctionWithSender(nullptr),
-        _senderPtr(nullptr)
+        _packetHandler(static_cast<HandlerType&&>(packetHandler))
     {
     }
 
@@ -64,6 +320,7 @@ public:
     {
     }
 
+#if defined(ARDUINO)
     /// \brief Begin a default serial connection with the given speed.
     ///
     /// The default Serial port `Serial` and default config `SERIAL_8N1` will be
@@ -80,6 +337,9 @@ public:
     /// configurations, use the `setStream()` function to set an arbitrary
     /// Arduino Stream.
     ///
+    /// This method is only available when building for an Arduino core. Host
+    /// builds must use `setStream()`.
+    ///
     /// \param speed The serial data transmission speed in bits / second (baud).
     /// \sa https://www.arduino.cc/en/Serial/Begin
     void begin(unsigned long speed)
@@ -131,6 +391,8 @@ public:
         }
     }
 
+#endif
+
     /// \brief Deprecated. Use setStream() to configure a non-default port.
     /// \param stream A pointer to an Arduino `Stream`.
     /// \deprecated Use setStream() to configure a non-default port.
@@ -196,6 +458,51 @@ public:
         return _stream;
     }
 
+    /// \brief Set the pool that provides the buffers of this instance.
+    ///
+    /// Several instances can share one PacketBufferPool_ whose blocks are at
+    /// least `ReceiveBufferSize` and `TransmitBufferSize` bytes:
+    ///
+    ///     PacketBufferPool_<256, 2> myBufferPool;
+    ///     PooledPacketSerial<PacketBufferPool_<256, 2> > myPacketSerial;
+    ///     PooledPacketSerial<PacketBufferPool_<256, 2> > myOtherPacketSerial;
+    ///
+    ///     void setup()
+    ///     {
+    ///         myPacketSerial.setBufferPool(&myBufferPool);
+    ///         myOtherPacketSerial.setBufferPool(&myBufferPool);
+    ///     }
+    ///
+    /// A block is borrowed when the first byte of a packet arrives and
+    /// returned after the packet handler returns, so the buffer passed to
+    /// the packet handler is only valid until it returns. Encoders without a
+    /// `StreamDecoder` borrow a second block to decode the packet into. If
+    /// no block is free, the packet is skipped up to the next packet marker
+    /// and dropped.
+    ///
+    /// With a `TransmitBufferSize`, a block is also borrowed while packets
+    /// are queued. If no block is free, `send()` writes the packet directly
+    /// to the stream and `trySend()` returns false.
+    ///
+    /// Call this before the first `update()` or `send()`.
+    ///
+    /// This method is only available if `BufferPoolType` is set.
+    ///
+    /// \param pool A pointer to the pool. It must outlive this instance.
+    void setBufferPool(BufferPoolType* pool)
+    {
+        static_assert(PacketPoolBuffer<ReceiveBufferSize, BufferPoolType>::IsPooled,
+                      "setBufferPool() requires a BufferPoolType.");
+
+        _receiveBufferIndex = 0;
+        _recieveBufferOverflow = false;
+        _receiveBufferUnavailable = false;
+
+        _receiveBuffer.setPool(pool);
+        _decodeBuffer.setPool(pool);
+        _transmitQueue.setBufferPool(pool);
+    }
+
     /// \brief The update function services the serial connection.
     ///
     /// This must be called often, ideally once per `loop()`, e.g.:
@@ -207,56 +514,122 @@ public:
     ///         myPacketSerial.update();
     ///     }
     ///
+    /// If the `EncoderType` provides a `StreamDecoder`, each byte is decoded as
+    /// it arrives and the packet handler receives the receive buffer directly.
+    /// In this case the buffer passed to the packet handler is only valid
+    /// until the next call to `update()`, or with a `BufferPoolType`, until
+    /// the packet handler returns.
+    ///
+    /// If `PACKETSERIAL_READ_CHUNK_SIZE` is defined, the packet handler must
+    /// not call `update()`, because bytes that were already read from the
+    /// stream are still waiting to be processed.
+    ///
+    /// If a `TransmitBufferSize` is set, `update()` also writes as many
+    /// queued bytes as `Stream::availableForWrite()` allows, once they are
+    /// ready to be sent (see `setBatching()`).
     void update()
     {
-        if (_stream == nullptr) return;
+        update(static_cast<size_t>(-1), static_cast<size_t>(-1));
+    }
+
+    /// \brief Service the serial connection for a limited amount of work.
+    ///
+    /// This works like `update()`, but returns once \p maxBytes bytes have
+    /// been read or \p maxPackets packet markers have been processed, even if
+    /// more bytes are available. This bounds the time spent in each call, e.g.
+    /// when several ports are serviced in turn from one `loop()`.
+    ///
+    /// If `PACKETSERIAL_READ_CHUNK_SIZE` is defined, the bytes of a chunk are
+    /// always processed completely, so more than \p maxPackets packets may be
+    /// processed. At most \p maxBytes bytes are still read.
+    ///
+    /// \param maxBytes The maximum number of bytes to read from the stream.
+    /// \param maxPackets The maximum number of packet markers to process.
+    /// \returns the number of bytes read from the stream.
+    size_t update(size_t maxBytes, size_t maxPackets)
+    {
+        if (_stream == nullptr) return 0;
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        uint32_t start = micros();
+#endif
+
+        typename EncoderTraits<EncoderType>::StreamDecoderTag tag;
+
+        size_t numRead = 0;
+        size_t numPackets = 0;
+
+#if PACKETSERIAL_READ_CHUNK_SIZE > 0
+        uint8_t chunk[PACKETSERIAL_READ_CHUNK_SIZE];
+        int available = 0;
+
+        while (numRead < maxBytes &&
+               numPackets < maxPackets &&
+               (available = _stream->available()) > 0)
+        {
+            size_t size = static_cast<size_t>(available);
+
+            if (size > PACKETSERIAL_READ_CHUNK_SIZE)
+                size = PACKETSERIAL_READ_CHUNK_SIZE;
+
+            if (size > maxBytes - numRead)
+                size = maxBytes - numRead;
+
+            size = _stream->readBytes(reinterpret_cast<char*>(chunk), size);
+            numRead += size;
+
+            const uint8_t* data = chunk;
+
+            while (size > 0)
+            {
+                size_t index = ByteSearch::find(data, size, PacketMarker);
+
+                if (!isResyncing())
+                    receiveBytes(data, index, tag);
+
+                if (index == size)
+                    break;
+
+                dispatchPacket(tag);
+                numPackets++;
 
-        while (_stream->available() > 0)
+                data += index + 1;
+                size -= index + 1;
+            }
+        }
+#else
+        while (numRead < maxBytes &&
+               numPackets < maxPackets &&
+               _stream->available() > 0)
         {
             uint8_t data = _stream->read();
+            numRead++;
 
             if (data == PacketMarker)
             {
-                if (_onPacketFunction || _onPacketFunctionWithSender)
-                {
-                    uint8_t _decodeBuffer[_receiveBufferIndex];
-
-                    size_t numDecoded = EncoderType::decode(_receiveBuffer,
-                                                            _receiveBufferIndex,
-                                                            _decodeBuffer);
-
-                    // clear the index here so that the callback function can call update() if needed and receive more data
-                    _receiveBufferIndex = 0;
-                    _recieveBufferOverflow = false;
-
-                    if (_onPacketFunction)
-                    {
-                        _onPacketFunction(_decodeBuffer, numDecoded);
-                    }
-                    else if (_onPacketFunctionWithSender)
-                    {
-                        _onPacketFunctionWithSender(_senderPtr, _decodeBuffer, numDecoded);
-                    }
-
-                } else {
-                    _receiveBufferIndex = 0;
-                    _recieveBufferOverflow = false;
-                }
+                dispatchPacket(tag);
+                numPackets++;
             }
-            else
+            else if (!isResyncing())
             {
-                if ((_receiveBufferIndex + 1) < ReceiveBufferSize)
-                {
-                    _receiveBuffer[_receiveBufferIndex++] = data;
-                }
-                else
-                {
-                    // The buffer will be in an overflowed state if we write
-                    // so set a buffer overflowed flag.
-                    _recieveBufferOverflow = true;
-                }
+                receiveByte(data, tag);
             }
         }
+#endif
+
+        if (_transmitQueue.isReady())
+            writeAvailable();
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        _statistics.bytesReceived += numRead;
+
+        uint32_t elapsed = micros() - start;
+
+        if (elapsed > _statistics.maxUpdateMicros)
+            _statistics.maxUpdateMicros = elapsed;
+#endif
+
+        return numRead;
     }
 
     /// \brief Set a packet of data.
@@ -271,20 +644,314 @@ public:
     ///     // Send the array.
     ///     myPacketSerial.send(myPacket, 2);
     ///
+    /// If the `EncoderType` provides a `StreamEncoder`, the packet is encoded
+    /// directly to the `Stream` and no encode buffer is allocated, regardless
+    /// of the packet size. Otherwise packets larger than `MaxPacketSize` are
+    /// not sent.
+    ///
+    /// If a `TransmitBufferSize` is set, the packet is queued like with
+    /// `trySend()`. If it does not fit the transmit buffer, the queued bytes
+    /// and then the packet are written to the stream immediately.
+    ///
     /// \param buffer A pointer to a data buffer.
     /// \param size The number of bytes in the data buffer.
     void send(const uint8_t* buffer, size_t size) const
     {
         if(_stream == nullptr || buffer == nullptr || size == 0) return;
 
-        uint8_t _encodeBuffer[EncoderType::getEncodedBufferSize(size)];
+        if (queuePacket(buffer, size)) return;
 
-        size_t numEncoded = EncoderType::encode(buffer,
-                                                size,
-                                                _encodeBuffer);
+        writeQueue();
+
+        size_t numEncoded = encodePacket(buffer,
+                                         size,
+                                         *_stream,
+                                         typename EncoderTraits<EncoderType>::StreamEncoderTag());
+
+        if (numEncoded == 0) return;
+
+        _stream->write(PacketMarker);
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        _statistics.bytesSent += numEncoded + 1;
+        _statistics.packetsSent++;
+#endif
+    }
+
+    /// \brief Send a packet made of several segments.
+    ///
+    /// This function will encode and send the segments as a single packet
+    /// without first copying them into one buffer. After sending, it will send
+    /// the specified `PacketMarker` defined in the template parameters.
+    ///
+    ///     // Describe the packet.
+    ///     PacketSegment segments[3] = {
+    ///         { reinterpret_cast<const uint8_t*>(&header), sizeof(header) },
+    ///         { payload, payloadSize },
+    ///         { reinterpret_cast<const uint8_t*>(&checksum), sizeof(checksum) }
+    ///     };
+    ///
+    ///     // Send the segments.
+    ///     myPacketSerial.send(segments, 3);
+    ///
+    /// \param segments A pointer to a list of segments.
+    /// \param count The number of segments in the list.
+    void send(const PacketSegment* segments, size_t count) const
+    {
+        if(_stream == nullptr || segments == nullptr) return;
+
+        size_t size = PacketSegment::totalSize(segments, count);
+
+        if (size == 0) return;
+
+        if (queuePacket(segments, count, size)) return;
+
+        writeQueue();
+
+        size_t numEncoded = encodePacket(segments,
+                                         count,
+                                         size,
+                                         *_stream,
+                                         typename EncoderTraits<EncoderType>::StreamEncoderTag());
+
+        if (numEncoded == 0) return;
 
-        _stream->write(_encodeBuffer, numEncoded);
         _stream->write(PacketMarker);
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        _statistics.bytesSent += numEncoded + 1;
+        _statistics.packetsSent++;
+#endif
+    }
+
+    /// \brief Send a struct as a packet.
+    ///
+    /// The bytes of the struct are encoded directly, without first copying
+    /// them into a byte array:
+    ///
+    ///     struct Position
+    ///     {
+    ///         uint8_t id;
+    ///         LittleEndian<int16_t> x;
+    ///         LittleEndian<int16_t> y;
+    ///     };
+    ///
+    ///     Position position;
+    ///     position.id = 2;
+    ///     position.x = 100;
+    ///     position.y = -100;
+    ///
+    ///     myPacketSerial.send(position);
+    ///
+    /// The struct must be trivially copyable. To give it the same layout on
+    /// every target, use LittleEndian fields for multi-byte numbers. The
+    /// receiver can read it in place with packetCast().
+    ///
+    /// \tparam T The type of the struct.
+    /// \param value The struct to send.
+    template<typename T>
+    void send(const T& value) const
+    {
+        static_assert(EncoderTraits<EncoderType>::HasStreamEncoder || sizeof(T) <= MaxPacketSize,
+                      "T is larger than MaxPacketSize.");
+        static_assert(__is_trivially_copyable(T), "T must be trivially copyable.");
+
+        send(reinterpret_cast<const uint8_t*>(&value), sizeof(T));
+    }
+
+    /// \brief Pointers are not sent as structs. Use send(buffer, size).
+    template<typename T>
+    void send(T* value) const = delete;
+
+    /// \brief Queue a packet without blocking.
+    ///
+    /// The packet is encoded into the transmit buffer, and the queued bytes
+    /// are written to the stream by `update()` as the stream has room for
+    /// them, so a full UART transmit buffer never blocks the caller:
+    ///
+    ///     PacketSerial_<COBS, 0, 256, 254, 512> myPacketSerial;
+    ///
+    ///     void loop()
+    ///     {
+    ///         myPacketSerial.update();
+    ///
+    ///         if (!myPacketSerial.trySend(myPacket, sizeof(myPacket)))
+    ///         {
+    ///             // The transmit buffer is full. Drop the packet or retry
+    ///             // later.
+    ///         }
+    ///     }
+    ///
+    /// Space for the largest possible encoding of the packet must be free,
+    /// so a packet may be rejected even though its actual encoding would fit.
+    ///
+    /// `update()` writes only as many bytes as `Stream::availableForWrite()`
+    /// reports. Streams that do not implement `availableForWrite()` report 0,
+    /// in which case `flush()` must be called to write the queued bytes.
+    ///
+    /// This method is only available if `TransmitBufferSize` is not 0.
+    ///
+    /// \param buffer A pointer to a data buffer.
+    /// \param size The number of bytes in the data buffer.
+    /// \returns true if the packet was queued, false if the transmit buffer
+    ///          is full or the packet could not be encoded.
+    bool trySend(const uint8_t* buffer, size_t size)
+    {
+        static_assert(TransmitBufferSize > 0, "trySend() requires a TransmitBufferSize.");
+
+        if(_stream == nullptr || buffer == nullptr || size == 0) return false;
+
+        if (queuePacket(buffer, size)) return true;
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        _statistics.sendsRejected++;
+#endif
+
+        return false;
+    }
+
+    /// \brief Queue a packet made of several segments without blocking.
+    /// \param segments A pointer to a list of segments.
+    /// \param count The number of segments in the list.
+    /// \returns true if the packet was queued, false if the transmit buffer
+    ///          is full or the packet could not be encoded.
+    /// \sa trySend(const uint8_t*, size_t)
+    bool trySend(const PacketSegment* segments, size_t count)
+    {
+        static_assert(TransmitBufferSize > 0, "trySend() requires a TransmitBufferSize.");
+
+        if(_stream == nullptr || segments == nullptr) return false;
+
+        size_t size = PacketSegment::totalSize(segments, count);
+
+        if (size == 0) return false;
+
+        if (queuePacket(segments, count, size)) return true;
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        _statistics.sendsRejected++;
+#endif
+
+        return false;
+    }
+
+    /// \brief Batch small packets into fewer, larger writes.
+    ///
+    /// By default queued bytes are written as soon as the stream has room for
+    /// them, so each packet usually becomes its own `Stream::write()` call. On
+    /// USB CDC cores, each call can become its own USB transfer. With
+    /// batching, queued bytes are held until \p minBytes are queued or the
+    /// oldest queued byte has waited \p maxDelayMicros, and are then written
+    /// with a single `Stream::write()`:
+    ///
+    ///     PacketSerial_<COBS, 0, 256, 254, 512> myPacketSerial;
+    ///
+    ///     void setup()
+    ///     {
+    ///         myPacketSerial.begin(115200);
+    ///
+    ///         // Write 256 bytes at a time, or whatever is queued after 2 ms.
+    ///         myPacketSerial.setBatching(256, 2000);
+    ///     }
+    ///
+    /// `flush()` writes the queued bytes immediately.
+    ///
+    /// This method is only available if `TransmitBufferSize` is not 0.
+    ///
+    /// \param minBytes The number of queued bytes that are written at once,
+    ///        or 0 to disable batching. Values larger than
+    ///        `TransmitBufferSize` are reduced to `TransmitBufferSize`.
+    /// \param maxDelayMicros The longest time a packet waits in the queue
+    ///        before it is written, in microseconds. The delay is only
+    ///        checked by `update()`.
+    void setBatching(size_t minBytes, uint32_t maxDelayMicros)
+    {
+        static_assert(TransmitBufferSize > 0, "setBatching() requires a TransmitBufferSize.");
+
+        _transmitQueue.setBatching(minBytes, maxDelayMicros);
+    }
+
+    /// \brief Queue a struct as a packet without blocking.
+    /// \tparam T The type of the struct.
+    /// \param value The struct to send.
+    /// \returns true if the packet was queued.
+    /// \sa send(const T&), trySend(const uint8_t*, size_t)
+    template<typename T>
+    bool trySend(const T& value)
+    {
+        static_assert(EncoderTraits<EncoderType>::HasStreamEncoder || sizeof(T) <= MaxPacketSize,
+                      "T is larger than MaxPacketSize.");
+        static_assert(__is_trivially_copyable(T), "T must be trivially copyable.");
+
+        return trySend(reinterpret_cast<const uint8_t*>(&value), sizeof(T));
+    }
+
+    /// \brief Pointers are not sent as structs. Use trySend(buffer, size).
+    template<typename T>
+    bool trySend(T* value) = delete;
+
+    /// \brief View a received packet as a struct without copying it.
+    ///
+    /// This works like ::packetCast(), but also checks at compile time that
+    /// a T fits in a packet of `MaxPacketSize` bytes:
+    ///
+    ///     void onPacketReceived(const uint8_t* buffer, size_t size)
+    ///     {
+    ///         const Position* position = PacketSerial::packetCast<Position>(buffer, size);
+    ///
+    ///         if (position)
+    ///         {
+    ///             // Use position->x and position->y.
+    ///         }
+    ///     }
+    ///
+    /// \tparam T The type of the struct.
+    /// \param buffer A pointer to the decoded packet.
+    /// \param size The number of bytes in the packet.
+    /// \returns a pointer to the packet as a T, or nullptr if the size of the
+    ///          packet is not `sizeof(T)`.
+    template<typename T>
+    static const T* packetCast(const uint8_t* buffer, size_t size)
+    {
+        static_assert(sizeof(T) <= MaxPacketSize,
+                      "T is larger than MaxPacketSize and can never be received.");
+
+        return ::packetCast<T>(buffer, size);
+    }
+
+    /// \brief Write all queued bytes to the stream.
+    ///
+    /// Unlike `update()`, this blocks until the stream has accepted all
+    /// queued bytes, regardless of the batching settings.
+    void flush()
+    {
+        if (_stream == nullptr) return;
+
+        writeQueue();
+    }
+
+    /// \returns the number of encoded bytes waiting in the transmit buffer.
+    size_t getQueuedBytes() const
+    {
+        return _transmitQueue.size();
+    }
+
+    /// \brief Get the largest number of bytes queued in the transmit buffer.
+    ///
+    /// Compare this with `TransmitBufferSize` to tune the transmit buffer
+    /// size.
+    ///
+    /// \returns the high-water mark since the last call to
+    ///          resetMaxQueuedBytes().
+    size_t getMaxQueuedBytes() const
+    {
+        return _transmitQueue.maxSize();
+    }
+
+    /// \brief Reset the transmit buffer high-water mark.
+    void resetMaxQueuedBytes()
+    {
+        _transmitQueue.resetMaxSize();
     }
 
     /// \brief Set the function that will receive decoded packets.
@@ -306,9 +973,9 @@ public:
     /// \param onPacketFunction A pointer to the packet handler function.
     void setPacketHandler(PacketHandlerFunction onPacketFunction)
     {
-        _onPacketFunction = onPacketFunction;
-        _onPacketFunctionWithSender = nullptr;
-        _senderPtr = nullptr;
+        _packetHandler.onPacketFunction = onPacketFunction;
+        _packetHandler.onPacketFunctionWithSender = nullptr;
+        _packetHandler.senderPtr = nullptr;
     }
 
     /// \brief Set the function that will receive decoded packets.
@@ -371,11 +1038,25 @@ public:
     /// \param senderPtr Optional pointer to a void* pointer, default argument will pass a pointer to the sending PacketSerial instance to the callback
     void setPacketHandler(PacketHandlerFunctionWithSender onPacketFunctionWithSender, void * senderPtr = nullptr)
     {
-        _onPacketFunction = nullptr;
-        _onPacketFunctionWithSender = onPacketFunctionWithSender;
-        _senderPtr = senderPtr;
+        _packetHandler.onPacketFunction = nullptr;
+        _packetHandler.onPacketFunctionWithSender = onPacketFunctionWithSender;
+        _packetHandler.senderPtr = senderPtr;
         // for backwards compatibility, the default _senderPtr is "this", but you can't use "this" as a default argument
-        if(!senderPtr) _senderPtr = this;
+        if(!senderPtr) _packetHandler.senderPtr = this;
+    }
+
+    /// \brief Get the packet handler passed to the constructor.
+    ///
+    /// This can be used to inspect or replace the state of the packet
+    /// handler, e.g. to set the object of a PacketMemberHandler.
+    ///
+    /// This method is only available if `PacketHandlerType` is set.
+    ///
+    /// \returns a reference to the packet handler.
+    template<typename HandlerType = PacketHandlerType>
+    HandlerType& getPacketHandler()
+    {
+        return _packetHandler.handler;
     }
 
     /// \brief Check to see if the receive buffer overflowed.
@@ -407,20 +1088,573 @@ public:
         return _recieveBufferOverflow;
     }
 
+    /// \brief Drop packets that overflow the receive buffer.
+    ///
+    /// By default, a packet that overflows the receive buffer is truncated
+    /// and the truncated packet is still decoded and passed to the packet
+    /// handler at the next packet marker. In resync mode, a packet is dropped
+    /// as soon as it overflows: the bytes up to the next packet marker are
+    /// skipped without being decoded or stored, and the packet handler is not
+    /// called for it.
+    ///
+    /// If `PACKETSERIAL_READ_CHUNK_SIZE` is defined, the skipped bytes are
+    /// read in chunks and the next packet marker is found with one search per
+    /// chunk. Otherwise each skipped byte is still read with `read()`.
+    ///
+    /// \param resync True to drop packets that overflow the receive buffer.
+    void setResyncOnOverflow(bool resync)
+    {
+        _resyncOnOverflow = resync;
+    }
+
+    /// \brief Set the function that is called for each packet that overflowed
+    ///        the receive buffer.
+    ///
+    /// The overflow handler is called when the packet marker that ends the
+    /// packet arrives, before the packet is passed to the packet handler or,
+    /// in resync mode, dropped.
+    ///
+    /// \param onOverflowFunction A pointer to the overflow handler function.
+    /// \param senderPtr The pointer passed to the overflow handler. By
+    ///        default it is a pointer to this PacketSerial_ instance.
+    void setOverflowHandler(OverflowHandlerFunction onOverflowFunction, void* senderPtr = nullptr)
+    {
+        _onOverflowFunction = onOverflowFunction;
+        _overflowSenderPtr = senderPtr ? senderPtr : this;
+    }
+
+    /// \returns the number of packets that overflowed the receive buffer.
+    uint32_t getOverflowCount() const
+    {
+        return _overflowCount;
+    }
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+    /// \brief Get the statistics collected since the last reset.
+    ///
+    /// Unlike `overflow()`, the counters accumulate until
+    /// `resetStatistics()` is called. To sample them periodically, e.g.:
+    ///
+    ///     void loop()
+    ///     {
+    ///         myPacketSerial.update();
+    ///
+    ///         if (millis() - lastReport > 10000)
+    ///         {
+    ///             const PacketSerialStatistics& stats = myPacketSerial.getStatistics();
+    ///             // Report stats.overflows, stats.maxPacketSize, etc.
+    ///             myPacketSerial.resetStatistics();
+    ///             lastReport = millis();
+    ///         }
+    ///     }
+    ///
+    /// This method is only available if `PACKETSERIAL_ENABLE_STATISTICS` is
+    /// defined as `1`.
+    ///
+    /// \returns the statistics of this instance.
+    const PacketSerialStatistics& getStatistics() const
+    {
+        return _statistics;
+    }
+
+    /// \brief Reset all statistics to zero.
+    void resetStatistics()
+    {
+        _statistics.reset();
+    }
+#endif
+
 private:
     PacketSerial_(const PacketSerial_&);
     PacketSerial_& operator = (const PacketSerial_&);
 
+    // Writes encoded bytes to the space reserved in the transmit queue.
+    struct QueueSink
+    {
+        uint8_t* buffer;
+
+        size_t write(uint8_t data)
+        {
+            *buffer++ = data;
+            return 1;
+        }
+
+        size_t write(const uint8_t* data, size_t size)
+        {
+            memcpy(buffer, data, size);
+            buffer += size;
+            return size;
+        }
+    };
+
+    bool queuePacket(const uint8_t* buffer, size_t size) const
+    {
+        uint8_t* data = reserve(EncoderType::getEncodedBufferSize(size) + 1);
+
+        if (data == nullptr) return false;
+
+        QueueSink sink = { data };
+
+        size_t numEncoded = encodePacket(buffer,
+                                         size,
+                                         sink,
+                                         typename EncoderTraits<EncoderType>::StreamEncoderTag());
+
+        return commitPacket(data, numEncoded);
+    }
+
+    bool queuePacket(const PacketSegment* segments, size_t count, size_t size) const
+    {
+        uint8_t* data = reserve(EncoderType::getEncodedBufferSize(size) + 1);
+
+        if (data == nullptr) return false;
+
+        QueueSink sink = { data };
+
+        size_t numEncoded = encodePacket(segments,
+                                         count,
+                                         size,
+                                         sink,
+                                         typename EncoderTraits<EncoderType>::StreamEncoderTag());
+
+        return commitPacket(data, numEncoded);
+    }
+
+    uint8_t* reserve(size_t size) const
+    {
+        uint8_t* data = _transmitQueue.reserve(size);
+
+        // A batch is complete when the next packet does not fit.
+        if (data == nullptr && _transmitQueue.size() > 0)
+        {
+            writeAvailable();
+            data = _transmitQueue.reserve(size);
+        }
+
+        return data;
+    }
+
+    bool commitPacket(uint8_t* data, size_t numEncoded) const
+    {
+        if (numEncoded == 0) return false;
+
+        data[numEncoded] = PacketMarker;
+        _transmitQueue.commit(numEncoded + 1);
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        _statistics.bytesSent += numEncoded + 1;
+        _statistics.packetsSent++;
+#endif
+
+        if (_transmitQueue.isReady())
+            writeAvailable();
+
+        return true;
+    }
+
+    // Write as many queued bytes as the stream accepts without blocking.
+    void writeAvailable() const
+    {
+        int space = _stream->availableForWrite();
+
+        if (space > 0 && _transmitQueue.write(*_stream, static_cast<size_t>(space)) > 0)
+        {
+#if PACKETSERIAL_ENABLE_STATISTICS
+            _statistics.batchesSent++;
+#endif
+        }
+    }
+
+    // Write all queued bytes, waiting for the stream if needed.
+    void writeQueue() const
+    {
+        while (_transmitQueue.size() > 0 &&
+               _transmitQueue.write(*_stream, _transmitQueue.size()) > 0)
+        {
+#if PACKETSERIAL_ENABLE_STATISTICS
+            _statistics.batchesSent++;
+#endif
+        }
+    }
+
+    template<typename Sink>
+    size_t encodePacket(const uint8_t* buffer, size_t size, Sink& sink, EncoderFeature<false>) const
+    {
+        if (size > MaxPacketSize)
+            return 0;
+
+        size_t numEncoded = EncoderType::encode(buffer,
+                                                size,
+                                                _encodeBuffer.data);
+
+        sink.write(_encodeBuffer.data, numEncoded);
+        return numEncoded;
+    }
+
+    template<typename Sink>
+    size_t encodePacket(const uint8_t* buffer, size_t size, Sink& sink, EncoderFeature<true>) const
+    {
+        return EncoderType::StreamEncoder::encode(buffer, size, sink);
+    }
+
+    template<typename Sink>
+    size_t encodePacket(const PacketSegment* segments,
+                        size_t count,
+                        size_t size,
+                        Sink& sink,
+                        EncoderFeature<false>) const
+    {
+        if (size > MaxPacketSize)
+            return 0;
+
+        size_t offset = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            memcpy(_packetBuffer.data + offset, segments[i].buffer, segments[i].size);
+            offset += segments[i].size;
+        }
+
+        return encodePacket(_packetBuffer.data, size, sink, EncoderFeature<false>());
+    }
+
+    template<typename Sink>
+    size_t encodePacket(const PacketSegment* segments,
+                        size_t count,
+                        size_t,
+                        Sink& sink,
+                        EncoderFeature<true>) const
+    {
+        return EncoderType::StreamEncoder::encode(segments, count, sink);
+    }
+
+    void receiveByte(uint8_t data, EncoderFeature<false>)
+    {
+        if (!acquireReceiveBuffer())
+            return;
+
+        if ((_receiveBufferIndex + 1) < ReceiveBufferSize)
+        {
+            _receiveBuffer.data()[_receiveBufferIndex++] = data;
+        }
+        else
+        {
+            // The buffer will be in an overflowed state if we write
+            // so set a buffer overflowed flag.
+            _recieveBufferOverflow = true;
+        }
+    }
+
+    void receiveByte(uint8_t data, EncoderFeature<true>)
+    {
+        if (!acquireReceiveBuffer())
+            return;
+
+        uint8_t decoded;
+
+        if (_decoder.decode(data, decoded))
+        {
+            if (_receiveBufferIndex < MaxPacketSize)
+            {
+                _receiveBuffer.data()[_receiveBufferIndex++] = decoded;
+            }
+            else
+            {
+                _recieveBufferOverflow = true;
+            }
+        }
+    }
+
+    void receiveBytes(const uint8_t* data, size_t size, EncoderFeature<false>)
+    {
+        if (size == 0 || !acquireReceiveBuffer())
+            return;
+
+        size_t space = ReceiveBufferSize - 1 - _receiveBufferIndex;
+
+        if (size > space)
+        {
+            size = space;
+            _recieveBufferOverflow = true;
+        }
+
+        memcpy(_receiveBuffer.data() + _receiveBufferIndex, data, size);
+        _receiveBufferIndex += size;
+    }
+
+    void receiveBytes(const uint8_t* data, size_t size, EncoderFeature<true> tag)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            receiveByte(data[i], tag);
+        }
+    }
+
+    bool isResyncing() const
+    {
+        return (_resyncOnOverflow && _recieveBufferOverflow) || isReceiveBufferUnavailable();
+    }
+
+    bool isReceiveBufferUnavailable() const
+    {
+        return PacketPoolBuffer<ReceiveBufferSize, BufferPoolType>::IsPooled && _receiveBufferUnavailable;
+    }
+
+    // Borrow a receive buffer from the pool for a new packet. If none is
+    // free, the packet is skipped until the next packet marker.
+    bool acquireReceiveBuffer()
+    {
+        if (isReceiveBufferUnavailable())
+            return false;
+
+        if (_receiveBuffer.acquire())
+            return true;
+
+        _receiveBufferUnavailable = true;
+        return false;
+    }
+
+    // Drop a packet that had no buffer. Returns true if the packet was dropped.
+    bool dropUnavailable()
+    {
+        if (!isReceiveBufferUnavailable())
+            return false;
+
+        _receiveBufferIndex = 0;
+        _recieveBufferOverflow = false;
+        _receiveBufferUnavailable = false;
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        _statistics.poolExhausted++;
+#endif
+
+        return true;
+    }
+
+    // Count an overflowed packet and, in resync mode, drop it. Returns true if
+    // the packet was dropped.
+    bool dropOverflow()
+    {
+        if (!_recieveBufferOverflow)
+            return false;
+
+        _overflowCount++;
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        _statistics.overflows++;
+#endif
+
+        if (_onOverflowFunction)
+            _onOverflowFunction(_overflowSenderPtr);
+
+        if (!_resyncOnOverflow)
+            return false;
+
+        _receiveBufferIndex = 0;
+        _recieveBufferOverflow = false;
+        return true;
+    }
+
+    bool decodePacket(uint8_t* decodedBuffer, size_t& numDecoded, EncoderFeature<true>)
+    {
+        return EncoderType::tryDecode(_receiveBuffer.data(),
+                                      _receiveBufferIndex,
+                                      decodedBuffer,
+                                      numDecoded);
+    }
+
+    bool decodePacket(uint8_t* decodedBuffer, size_t& numDecoded, EncoderFeature<false>)
+    {
+        numDecoded = EncoderType::decode(_receiveBuffer.data(),
+                                         _receiveBufferIndex,
+                                         decodedBuffer);
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        if (numDecoded == 0 && _receiveBufferIndex > 0)
+            _statistics.decodeErrors++;
+#endif
+
+        return true;
+    }
+
+    void dispatchPacket(EncoderFeature<false>)
+    {
+        if (dropOverflow() || dropUnavailable())
+        {
+            _receiveBuffer.release();
+            return;
+        }
+
+        if (hasPacketHandler(_packetHandler) && _decodeBuffer.acquire())
+        {
+            typename EncoderTraits<EncoderType>::TryDecodeTag tag;
+
+            // A truncated packet cannot decode cleanly, but is still passed
+            // to the packet handler as decode() returns it, as documented in
+            // setResyncOnOverflow().
+            size_t numDecoded = 0;
+            bool valid = _recieveBufferOverflow ?
+                         decodePacket(_decodeBuffer.data(), numDecoded, EncoderFeature<false>()) :
+                         decodePacket(_decodeBuffer.data(), numDecoded, tag);
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+            if (!valid)
+                _statistics.decodeErrors++;
+#endif
+
+            // clear the index here so that the callback function can call update() if needed and receive more data
+            _receiveBufferIndex = 0;
+            _recieveBufferOverflow = false;
+            _receiveBuffer.release();
+
+            uint8_t* decoded = _decodeBuffer.detach();
+
+            // Packets that fail to decode are dropped.
+            if (valid)
+            {
+                onPacket(decoded, numDecoded);
+            }
+
+            _decodeBuffer.release(decoded);
+        }
+        else
+        {
+#if PACKETSERIAL_ENABLE_STATISTICS
+            if (hasPacketHandler(_packetHandler))
+                _statistics.poolExhausted++;
+#endif
+
+            _receiveBufferIndex = 0;
+            _recieveBufferOverflow = false;
+            _receiveBuffer.release();
+        }
+    }
+
+    void dispatchPacket(EncoderFeature<true>)
+    {
+        if (dropOverflow() || dropUnavailable())
+        {
+            _receiveBuffer.release();
+            _decoder.reset();
+            return;
+        }
+
+        size_t numDecoded = _receiveBufferIndex;
+        bool valid = _decoder.isValid();
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        if (!valid)
+            _statistics.decodeErrors++;
+#endif
+
+        _receiveBufferIndex = 0;
+        _recieveBufferOverflow = false;
+        _decoder.reset();
+
+        // The buffer is held until the packet handler returns, so that the
+        // packet handler can call update() and borrow another one.
+        uint8_t* buffer = _receiveBuffer.detach();
+
+        // An empty packet, e.g. from repeated packet markers, never borrows
+        // a block from the pool. The packet handler still gets a valid
+        // pointer, as it does without a pool.
+        uint8_t empty = 0;
+
+        // Packets that fail to decode are dropped.
+        if (valid)
+        {
+            onPacket(buffer != nullptr ? buffer : &empty, numDecoded);
+        }
+
+        _receiveBuffer.release(buffer);
+    }
+
+    static bool hasPacketHandler(const PacketHandlerStorage<void>& packetHandler)
+    {
+        return packetHandler.onPacketFunction || packetHandler.onPacketFunctionWithSender;
+    }
+
+    template<typename HandlerType>
+    static bool hasPacketHandler(const PacketHandlerStorage<HandlerType>&)
+    {
+        return true;
+    }
+
+    static void callPacketHandler(PacketHandlerStorage<void>& packetHandler,
+                                  const uint8_t* buffer,
+                                  size_t size)
+    {
+        if (packetHandler.onPacketFunction)
+        {
+            packetHandler.onPacketFunction(buffer, size);
+        }
+        else if (packetHandler.onPacketFunctionWithSender)
+        {
+            packetHandler.onPacketFunctionWithSender(packetHandler.senderPtr, buffer, size);
+        }
+    }
+
+    template<typename HandlerType>
+    static void callPacketHandler(PacketHandlerStorage<HandlerType>& packetHandler,
+                                  const uint8_t* buffer,
+                                  size_t size)
+    {
+        packetHandler.handler(buffer, size);
+    }
+
+    void onPacket(const uint8_t* buffer, size_t size)
+    {
+#if PACKETSERIAL_ENABLE_STATISTICS
+        if (!hasPacketHandler(_packetHandler))
+            return;
+
+        _statistics.packetsReceived++;
+
+        if (size > _statistics.maxPacketSize)
+            _statistics.maxPacketSize = size;
+
+        uint32_t start = micros();
+#endif
+
+        callPacketHandler(_packetHandler, buffer, size);
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+        uint32_t elapsed = micros() - start;
+
+        if (elapsed > _statistics.maxHandlerMicros)
+            _statistics.maxHandlerMicros = elapsed;
+#endif
+    }
+
     bool _recieveBufferOverflow = false;
+    bool _resyncOnOverflow = false;
+    uint32_t _overflowCount = 0;
 
-    uint8_t _receiveBuffer[ReceiveBufferSize];
+    OverflowHandlerFunction _onOverflowFunction = nullptr;
+    void* _overflowSenderPtr = nullptr;
+
+    bool _receiveBufferUnavailable = false;
+
+    PacketPoolBuffer<ReceiveBufferSize, BufferPoolType> _receiveBuffer;
     size_t _receiveBufferIndex = 0;
 
+    typename EncoderTraits<EncoderType>::StreamDecoder _decoder;
+
+    // Scratch buffers for encoders without a StreamEncoder or StreamDecoder.
+    // A decoded packet is never larger than the encoded packet.
+    PacketPoolBuffer<EncoderTraits<EncoderType>::HasStreamDecoder ? 0 : ReceiveBufferSize, BufferPoolType> _decodeBuffer;
+    mutable PacketScratchBuffer<EncoderTraits<EncoderType>::HasStreamEncoder ? 0 : MaxPacketSize> _packetBuffer;
+    mutable PacketScratchBuffer<EncoderTraits<EncoderType>::HasStreamEncoder ? 0 : EncoderType::getEncodedBufferSize(MaxPacketSize)> _encodeBuffer;
+
+    mutable PacketTransmitQueue<TransmitBufferSize, BufferPoolType> _transmitQueue;
+
     Stream* _stream = nullptr;
 
-    PacketHandlerFunction _onPacketFunction = nullptr;
-    PacketHandlerFunctionWithSender _onPacketFunctionWithSender = nullptr;
-    void* _senderPtr = nullptr;
+    PacketHandlerStorage<PacketHandlerType> _packetHandler;
+
+#if PACKETSERIAL_ENABLE_STATISTICS
+    mutable PacketSerialStatistics _statistics;
+#endif
 };
 
 
@@ -432,3 +1666,67 @@ typedef PacketSerial_<COBS> COBSPacketSerial;
 
 /// \brief A typedef for a PacketSerial type with SLIP encoding.
 typedef PacketSerial_<SLIP, SLIP::END> SLIPPacketSerial;
+
+
+/// \brief A PacketSerial_ whose packet handler type is a template parameter.
+///
+/// The packet handler is passed to the constructor and stored by value. It
+/// can be a PacketFunctionHandler, a PacketMemberHandler, a function object or
+/// a lambda, including a capturing lambda:
+///
+///     InlinePacketSerial<PacketFunctionHandler<&onPacketReceived> > myPacketSerial;
+///
+///     size_t count = 0;
+///     auto onPacket = [&count](const uint8_t* buffer, size_t size) { count++; };
+///     InlinePacketSerial<decltype(onPacket)> myCountingPacketSerial(onPacket);
+///
+/// Because the handler is called directly instead of through a function
+/// pointer, the compiler can inline it into `update()`, and no function
+/// pointers are checked or stored.
+///
+/// \tparam PacketHandlerType The type of the packet handler.
+/// \tparam EncoderType The static packet encoder class name.
+/// \tparam PacketMarker The byte value used to mark the packet boundary.
+/// \tparam ReceiveBufferSize The number of bytes allocated for the receive buffer.
+template<typename PacketHandlerType,
+         typename EncoderType = COBS,
+         uint8_t PacketMarker = 0,
+         size_t ReceiveBufferSize = 256>
+using InlinePacketSerial = PacketSerial_<EncoderType,
+                                         PacketMarker,
+                                         ReceiveBufferSize,
+                                         EncoderTraits<EncoderType>::getMaxPacketSize(ReceiveBufferSize),
+                                         0,
+                                         PacketHandlerType>;
+
+
+/// \brief A PacketSerial_ whose buffers are borrowed from a shared buffer pool.
+///
+/// Several instances can share one PacketBufferPool_, so that the RAM used
+/// for buffers depends on how many ports receive a packet at the same time
+/// rather than on the number of ports:
+///
+///     PacketBufferPool_<256, 2> myBufferPool;
+///     PooledPacketSerial<PacketBufferPool_<256, 2> > myPacketSerials[4];
+///
+/// Each instance must be given the pool with `setBufferPool()`.
+///
+/// \tparam BufferPoolType The PacketBufferPool_ type.
+/// \tparam EncoderType The static packet encoder class name.
+/// \tparam PacketMarker The byte value used to mark the packet boundary.
+/// \tparam ReceiveBufferSize The number of bytes needed for the receive
+///         buffer. By default, the block size of the pool.
+/// \tparam TransmitBufferSize The number of bytes needed for queued encoded
+///         packets, or 0 to write every packet immediately.
+template<typename BufferPoolType,
+         typename EncoderType = COBS,
+         uint8_t PacketMarker = 0,
+         size_t ReceiveBufferSize = BufferPoolType::Size,
+         size_t TransmitBufferSize = 0>
+using PooledPacketSerial = PacketSerial_<EncoderType,
+                                         PacketMarker,
+                                         ReceiveBufferSize,
+                                         EncoderTraits<EncoderType>::getMaxPacketSize(ReceiveBufferSize),
+                                         TransmitBufferSize,
+                                         void,
+                                         BufferPoolType>;
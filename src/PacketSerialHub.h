@@ -0,0 +1,218 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "PacketSerial.h"
+
+
+/// \brief Services several PacketSerial_ ports from a single `loop()`.
+///
+/// Each call to `update()` services every port once, in round-robin order,
+/// and reads at most a fixed budget of bytes and packets from each port. A
+/// busy port can therefore not starve the others, and the time spent in
+/// `update()` is bounded by the sum of the budgets.
+///
+/// All ports share one packet handler, which receives the index of the port
+/// that received the packet:
+///
+///     PacketSerialHub<3> myHub;
+///
+///     void onPacketReceived(uint8_t port, const uint8_t* buffer, size_t size)
+///     {
+///         // Echo the packet to the port that sent it.
+///         myHub.send(port, buffer, size);
+///     }
+///
+///     void setup()
+///     {
+///         Serial1.begin(115200);
+///         Serial2.begin(115200);
+///         Serial3.begin(115200);
+///
+///         myHub.setStream(0, &Serial1);
+///         myHub.setStream(1, &Serial2);
+///         myHub.setStream(2, &Serial3);
+///         myHub.setPacketHandler(&onPacketReceived);
+///     }
+///
+///     void loop()
+///     {
+///         myHub.update();
+///     }
+///
+/// \tparam PacketSerialType The PacketSerial_ type of each port.
+/// \tparam PortCount The number of ports.
+template<typename PacketSerialType, uint8_t PortCount>
+class PacketSerialHub_
+{
+public:
+    static_assert(PortCount > 0, "PortCount must be at least 1.");
+
+    /// \brief A typedef describing the packet handler method.
+    ///
+    /// The packet handler method usually has the form:
+    ///
+    ///     void onPacketReceived(uint8_t port, const uint8_t* buffer, size_t size);
+    ///
+    /// where port is the index of the port that received the packet, buffer
+    /// is a pointer to the incoming buffer array, and size is the number of
+    /// bytes in the incoming buffer.
+    typedef void (*PacketHandlerFunction)(uint8_t port, const uint8_t* buffer, size_t size);
+
+    enum
+    {
+        /// \brief The default number of bytes read from each port per update.
+        DefaultMaxBytes = 64
+    };
+
+    /// \brief Construct a PacketSerialHub_ without streams.
+    PacketSerialHub_()
+    {
+        for (uint8_t i = 0; i < PortCount; i++)
+        {
+            _ports[i].setPacketHandler(&onPacketReceived, this);
+            _maxBytes[i] = DefaultMaxBytes;
+            _maxPackets[i] = static_cast<size_t>(-1);
+        }
+    }
+
+    /// \brief Attach a port to an existing Arduino `Stream`.
+    /// \param port The index of the port.
+    /// \param stream A pointer to an Arduino `Stream`.
+    void setStream(uint8_t port, Stream* stream)
+    {
+        _ports[port].setStream(stream);
+    }
+
+    /// \brief Get a port.
+    ///
+    /// The port's packet handler is used by the hub and must not be changed.
+    ///
+    /// \param port The index of the port.
+    /// \returns the PacketSerial_ instance of the port.
+    PacketSerialType& getPort(uint8_t port)
+    {
+        return _ports[port];
+    }
+
+    /// \brief Get a port.
+    /// \param port The index of the port.
+    /// \returns the PacketSerial_ instance of the port.
+    const PacketSerialType& getPort(uint8_t port) const
+    {
+        return _ports[port];
+    }
+
+    /// \returns the number of ports.
+    uint8_t getPortCount() const
+    {
+        return PortCount;
+    }
+
+    /// \brief Set the function that will receive decoded packets from all ports.
+    /// \param onPacketFunction A pointer to the packet handler function.
+    void setPacketHandler(PacketHandlerFunction onPacketFunction)
+    {
+        _onPacketFunction = onPacketFunction;
+    }
+
+    /// \brief Set the amount of work done for every port in each update.
+    /// \param maxBytes The maximum number of bytes read from each port.
+    /// \param maxPackets The maximum number of packets received from each port.
+    void setBudget(size_t maxBytes, size_t maxPackets = static_cast<size_t>(-1))
+    {
+        for (uint8_t i = 0; i < PortCount; i++)
+        {
+            setBudget(i, maxBytes, maxPackets);
+        }
+    }
+
+    /// \brief Set the amount of work done for one port in each update.
+    /// \param port The index of the port.
+    /// \param maxBytes The maximum number of bytes read from the port.
+    /// \param maxPackets The maximum number of packets received from the port.
+    /// \sa PacketSerial_::update(size_t, size_t)
+    void setBudget(uint8_t port, size_t maxBytes, size_t maxPackets)
+    {
+        _maxBytes[port] = maxBytes;
+        _maxPackets[port] = maxPackets;
+    }
+
+    /// \brief Service every port once.
+    ///
+    /// Each port is serviced with `PacketSerial_::update(size_t, size_t)`
+    /// using its budget. The port that is serviced first rotates with each
+    /// call, so no port is always serviced last.
+    ///
+    /// \returns the total number of bytes read from all ports.
+    size_t update()
+    {
+        size_t numRead = 0;
+
+        for (uint8_t i = 0; i < PortCount; i++)
+        {
+            _currentPort = static_cast<uint8_t>((_firstPort + i) % PortCount);
+            numRead += _ports[_currentPort].update(_maxBytes[_currentPort],
+                                                   _maxPackets[_currentPort]);
+        }
+
+        _firstPort = static_cast<uint8_t>((_firstPort + 1) % PortCount);
+
+        return numRead;
+    }
+
+    /// \brief Send a packet to a port.
+    /// \param port The index of the port.
+    /// \param buffer A pointer to a data buffer.
+    /// \param size The number of bytes in the data buffer.
+    /// \sa PacketSerial_::send()
+    void send(uint8_t port, const uint8_t* buffer, size_t size) const
+    {
+        _ports[port].send(buffer, size);
+    }
+
+    /// \brief Send a packet made of several segments to a port.
+    /// \param port The index of the port.
+    /// \param segments A pointer to a list of segments.
+    /// \param count The number of segments in the list.
+    /// \sa PacketSerial_::send()
+    void send(uint8_t port, const PacketSegment* segments, size_t count) const
+    {
+        _ports[port].send(segments, count);
+    }
+
+private:
+    PacketSerialHub_(const PacketSerialHub_&);
+    PacketSerialHub_& operator = (const PacketSerialHub_&);
+
+    static void onPacketReceived(const void* sender, const uint8_t* buffer, size_t size)
+    {
+        const PacketSerialHub_* hub = static_cast<const PacketSerialHub_*>(sender);
+
+        if (hub->_onPacketFunction)
+        {
+            hub->_onPacketFunction(hub->_currentPort, buffer, size);
+        }
+    }
+
+    PacketSerialType _ports[PortCount];
+
+    size_t _maxBytes[PortCount];
+    size_t _maxPackets[PortCount];
+
+    uint8_t _firstPort = 0;
+    uint8_t _currentPort = 0;
+
+    PacketHandlerFunction _onPacketFunction = nullptr;
+};
+
+
+/// \brief A PacketSerialHub_ of default COBS PacketSerial ports.
+template<uint8_t PortCount>
+using PacketSerialHub = PacketSerialHub_<PacketSerial, PortCount>;
@@ -0,0 +1,218 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include <Arduino.h>
+#include "PacketBufferPool.h"
+
+
+/// \brief A fixed-size queue of encoded bytes waiting to be written to a `Stream`.
+///
+/// Encoded packets are written directly into the space returned by
+/// `reserve()` and queued with `commit()`. `write()` writes queued bytes to a
+/// `Stream` from the front of the queue.
+///
+/// The queued bytes are always contiguous. When a packet does not fit after
+/// the last queued byte, the queued bytes are first moved to the front of the
+/// buffer. Because `write()` usually empties the queue, this rarely copies
+/// more than a partially written packet, and each `write()` is a single
+/// `Stream::write()` call.
+///
+/// Small packets can be batched with `setBatching()`, so that many packets
+/// are written with one `Stream::write()` call. `isReady()` then reports
+/// whether enough bytes are queued or the oldest queued byte has waited long
+/// enough.
+///
+/// If a `BufferPoolType` is set, the queue borrows a block from the pool set
+/// with `setBufferPool()` when a packet is queued and returns it when the
+/// queue is empty. `reserve()` returns nullptr while no block is free.
+///
+/// \tparam Size The number of bytes in the queue.
+/// \tparam BufferPoolType The PacketBufferPool_ type that provides the
+///         queue's buffer, or void to make the buffer a member.
+template<size_t Size, typename BufferPoolType = void>
+class PacketTransmitQueue
+{
+public:
+    /// \brief Set the pool that provides the queue's buffer.
+    ///
+    /// This method is only available if `BufferPoolType` is set.
+    ///
+    /// \param pool A pointer to the pool. It must outlive the queue.
+    void setBufferPool(BufferPoolType* pool)
+    {
+        _head = 0;
+        _tail = 0;
+        _buffer.setPool(pool);
+    }
+
+    /// \returns the number of queued bytes.
+    size_t size() const
+    {
+        return _tail - _head;
+    }
+
+    /// \returns the number of bytes that can be queued.
+    size_t capacity() const
+    {
+        return Size;
+    }
+
+    /// \returns the largest number of bytes queued since the last reset.
+    size_t maxSize() const
+    {
+        return _maxSize;
+    }
+
+    /// \brief Reset maxSize() to the number of currently queued bytes.
+    void resetMaxSize()
+    {
+        _maxSize = size();
+    }
+
+    /// \brief Set when queued bytes are ready to be written.
+    /// \param minSize The number of queued bytes that are written at once,
+    ///        or 0 to write bytes as soon as they are queued.
+    /// \param maxDelayMicros The longest time a queued byte waits for the
+    ///        batch to fill, in microseconds.
+    void setBatching(size_t minSize, uint32_t maxDelayMicros)
+    {
+        _batchSize = minSize < Size ? minSize : Size;
+        _batchDelay = maxDelayMicros;
+        _batchStart = micros();
+    }
+
+    /// \returns true if the queued bytes should be written.
+    bool isReady() const
+    {
+        return size() > 0 &&
+               (size() >= _batchSize || micros() - _batchStart >= _batchDelay);
+    }
+
+    /// \brief Get contiguous space for bytes to be queued.
+    /// \param size The number of bytes needed.
+    /// \returns a pointer to \p size bytes, or nullptr if they do not fit.
+    uint8_t* reserve(size_t size)
+    {
+        if (size > Size - this->size() || !_buffer.acquire())
+            return nullptr;
+
+        if (size > Size - _tail)
+        {
+            memmove(_buffer.data(), _buffer.data() + _head, this->size());
+            _tail -= _head;
+            _head = 0;
+        }
+
+        return _buffer.data() + _tail;
+    }
+
+    /// \brief Queue bytes written to the space returned by `reserve()`.
+    /// \param size The number of bytes written.
+    void commit(size_t size)
+    {
+        if (_batchSize > 0 && this->size() == 0)
+            _batchStart = micros();
+
+        _tail += size;
+
+        if (this->size() > _maxSize)
+            _maxSize = this->size();
+    }
+
+    /// \brief Write queued bytes to a stream.
+    /// \param stream The stream to write to.
+    /// \param maxBytes The maximum number of bytes to write.
+    /// \returns the number of bytes written.
+    size_t write(Stream& stream, size_t maxBytes)
+    {
+        size_t count = size();
+
+        if (count > maxBytes)
+            count = maxBytes;
+
+        if (count == 0)
+            return 0;
+
+        count = stream.write(_buffer.data() + _head, count);
+        _head += count;
+
+        if (_head == _tail)
+        {
+            _head = 0;
+            _tail = 0;
+            _buffer.release();
+        }
+
+        return count;
+    }
+
+private:
+    PacketPoolBuffer<Size, BufferPoolType> _buffer;
+    size_t _head = 0;
+    size_t _tail = 0;
+    size_t _maxSize = 0;
+
+    size_t _batchSize = 0;
+    uint32_t _batchDelay = 0;
+    uint32_t _batchStart = 0;
+};
+
+
+/// \brief An empty transmit queue that takes no space.
+template<typename BufferPoolType>
+class PacketTransmitQueue<0, BufferPoolType>
+{
+public:
+    void setBufferPool(BufferPoolType*)
+    {
+    }
+
+    size_t size() const
+    {
+        return 0;
+    }
+
+    size_t capacity() const
+    {
+        return 0;
+    }
+
+    size_t maxSize() const
+    {
+        return 0;
+    }
+
+    void resetMaxSize()
+    {
+    }
+
+    void setBatching(size_t, uint32_t)
+    {
+    }
+
+    bool isReady() const
+    {
+        return false;
+    }
+
+    uint8_t* reserve(size_t)
+    {
+        return nullptr;
+    }
+
+    void commit(size_t)
+    {
+    }
+
+    size_t write(Stream&, size_t)
+    {
+        return 0;
+    }
+};
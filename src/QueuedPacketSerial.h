@@ -0,0 +1,343 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "PacketSerial.h"
+#include "PacketRing.h"
+
+
+/// \brief A PacketSerial_ variant that queues received packets.
+///
+/// Instead of calling a packet handler for each packet, received packets are
+/// decoded directly into a ring of packet slots. The application reads them
+/// in place with `peek()` and returns them with `release()`, so several
+/// packets can be received while the application is busy and then processed
+/// in a batch.
+///
+///     QueuedPacketSerial myPacketSerial;
+///
+///     void loop()
+///     {
+///         myPacketSerial.update();
+///
+///         const uint8_t* buffer;
+///         size_t size;
+///
+///         while (myPacketSerial.peek(buffer, size))
+///         {
+///             // Process the packet.
+///             myPacketSerial.release();
+///         }
+///     }
+///
+/// Bytes can also be pushed from an interrupt service routine or a DMA
+/// callback with `receive()`, in which case `update()` only dispatches
+/// complete packets to the packet handler, if one is set:
+///
+///     QueuedPacketSerial myPacketSerial;
+///
+///     void onUartReceive(const uint8_t* block, size_t size)
+///     {
+///         myPacketSerial.receive(block, size);
+///     }
+///
+///     void loop()
+///     {
+///         // Calls the packet handler for each complete packet.
+///         myPacketSerial.update();
+///     }
+///
+/// The packet queue is a lock-free single-producer / single-consumer queue.
+/// The producer is either `update()` reading from the stream or a single
+/// context calling `receive()`, but not both. The consumer is the context
+/// that calls `peek()` and `release()` or `update()`.
+///
+/// The `EncoderType` must provide a `StreamEncoder` and a `StreamDecoder`.
+///
+/// \tparam EncoderType The static packet encoder class name.
+/// \tparam PacketMarker The byte value used to mark the packet boundary.
+/// \tparam SlotCount The number of packets that can be queued.
+/// \tparam SlotSize The maximum number of decoded bytes in each packet.
+template<typename EncoderType,
+         uint8_t PacketMarker = 0,
+         uint8_t SlotCount = 4,
+         size_t SlotSize = 64>
+class QueuedPacketSerial_
+{
+public:
+    static_assert(EncoderTraits<EncoderType>::HasStreamEncoder
+               && EncoderTraits<EncoderType>::HasStreamDecoder,
+                  "EncoderType must provide a StreamEncoder and a StreamDecoder.");
+
+    /// \brief A typedef describing the packet handler method.
+    /// \sa PacketSerial_::PacketHandlerFunction
+    typedef void (*PacketHandlerFunction)(const uint8_t* buffer, size_t size);
+
+    /// \brief A typedef describing the packet handler method.
+    /// \sa PacketSerial_::PacketHandlerFunctionWithSender
+    typedef void (*PacketHandlerFunctionWithSender)(const void* sender, const uint8_t* buffer, size_t size);
+
+    /// \brief Construct a default QueuedPacketSerial_ device.
+    QueuedPacketSerial_()
+    {
+    }
+
+    /// \brief Attach to an existing Arduino `Stream`.
+    /// \param stream A pointer to an Arduino `Stream`.
+    /// \sa PacketSerial_::setStream()
+    void setStream(Stream* stream)
+    {
+        _stream = stream;
+    }
+
+    /// \returns a non-const pointer to the stream, or nullptr if unset.
+    Stream* getStream()
+    {
+        return _stream;
+    }
+
+    /// \returns a const pointer to the stream, or nullptr if unset.
+    const Stream* getStream() const
+    {
+        return _stream;
+    }
+
+    /// \brief Service the stream and the packet queue.
+    ///
+    /// This must be called often, ideally once per `loop()`. If a stream is
+    /// set, available bytes are read and decoded into the packet queue. Then,
+    /// if a packet handler is set, each queued packet is passed to the packet
+    /// handler and released.
+    ///
+    /// Packets that arrive while all slots are full, that are larger than
+    /// `SlotSize` or that fail to decode are dropped.
+    void update()
+    {
+        if (_stream != nullptr)
+        {
+            while (_stream->available() > 0)
+            {
+                receive(static_cast<uint8_t>(_stream->read()));
+            }
+        }
+
+        if (_onPacketFunction || _onPacketFunctionWithSender)
+        {
+            const uint8_t* buffer;
+            size_t size;
+
+            while (_ring.peek(buffer, size))
+            {
+                if (_onPacketFunction)
+                {
+                    _onPacketFunction(buffer, size);
+                }
+                else
+                {
+                    _onPacketFunctionWithSender(_senderPtr, buffer, size);
+                }
+
+                _ring.release();
+            }
+        }
+    }
+
+    /// \brief Decode a received byte into the packet queue.
+    ///
+    /// This may be called from an interrupt service routine, as long as no
+    /// stream is set.
+    ///
+    /// \param data The received encoded byte.
+    void receive(uint8_t data)
+    {
+        if (data == PacketMarker)
+        {
+            if (_writeBuffer != nullptr && _decoder.isValid() && !_overflow)
+            {
+                _ring.commit(_writeIndex);
+            }
+            else if (_writeBuffer != nullptr || _overflow)
+            {
+                countDropped();
+            }
+
+            _writeBuffer = nullptr;
+            _writeIndex = 0;
+            _overflow = false;
+            _decoder.reset();
+            return;
+        }
+
+        uint8_t decoded;
+
+        if (!_decoder.decode(data, decoded) || _overflow)
+            return;
+
+        if (_writeBuffer == nullptr)
+            _writeBuffer = _ring.writeBuffer();
+
+        if (_writeBuffer != nullptr && _writeIndex < SlotSize)
+        {
+            _writeBuffer[_writeIndex++] = decoded;
+        }
+        else
+        {
+            _overflow = true;
+        }
+    }
+
+    /// \brief Decode a block of received bytes into the packet queue.
+    ///
+    /// This may be called from an interrupt service routine or a DMA
+    /// completion callback, as long as no stream is set. The block may
+    /// contain any number of partial or complete packets.
+    ///
+    /// \param data A pointer to the received encoded bytes.
+    /// \param size The number of bytes in \p data.
+    void receive(const uint8_t* data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            receive(data[i]);
+        }
+    }
+
+    /// \brief Get the oldest received packet without removing it.
+    /// \param buffer Set to a pointer to the decoded packet.
+    /// \param size Set to the number of bytes in the decoded packet.
+    /// \returns true if a packet was available.
+    bool peek(const uint8_t*& buffer, size_t& size) const
+    {
+        return _ring.peek(buffer, size);
+    }
+
+    /// \brief Remove the oldest received packet from the queue.
+    ///
+    /// The buffer returned by `peek()` must not be used after this call.
+    void release()
+    {
+        _ring.release();
+    }
+
+    /// \returns the number of received packets waiting in the queue.
+    size_t available() const
+    {
+        return _ring.size();
+    }
+
+    /// \brief Set the function that will receive queued packets in `update()`.
+    ///
+    /// Setting a packet handler will remove all other packet handlers. Passing
+    /// nullptr leaves packets in the queue for `peek()` and `release()`.
+    ///
+    /// \param onPacketFunction A pointer to the packet handler function.
+    /// \sa PacketSerial_::setPacketHandler()
+    void setPacketHandler(PacketHandlerFunction onPacketFunction)
+    {
+        _onPacketFunction = onPacketFunction;
+        _onPacketFunctionWithSender = nullptr;
+        _senderPtr = nullptr;
+    }
+
+    /// \brief Set the function that will receive queued packets in `update()`.
+    ///
+    /// Setting a packet handler will remove all other packet handlers.
+    ///
+    /// \param onPacketFunctionWithSender A pointer to the packet handler function.
+    /// \param senderPtr Optional pointer passed to the packet handler. By
+    ///        default a pointer to this instance is passed.
+    /// \sa PacketSerial_::setPacketHandler()
+    void setPacketHandler(PacketHandlerFunctionWithSender onPacketFunctionWithSender, void * senderPtr = nullptr)
+    {
+        _onPacketFunction = nullptr;
+        _onPacketFunctionWithSender = onPacketFunctionWithSender;
+        _senderPtr = senderPtr ? senderPtr : this;
+    }
+
+    /// \returns the number of packets dropped because the queue was full, the
+    ///          packet was too large or the packet failed to decode.
+    size_t dropped() const
+    {
+#if defined(__AVR__)
+        // The counter is two bytes, so an interrupt that calls receive()
+        // must not update it between the two loads.
+        uint8_t sreg = SREG;
+        cli();
+        size_t dropped = _dropped;
+        SREG = sreg;
+        return dropped;
+#elif defined(ESP8266)
+        return *static_cast<const volatile size_t*>(&_dropped);
+#else
+        return __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+#endif
+    }
+
+    /// \brief Encode and send a packet.
+    /// \param buffer A pointer to a data buffer.
+    /// \param size The number of bytes in the data buffer.
+    /// \sa PacketSerial_::send()
+    void send(const uint8_t* buffer, size_t size) const
+    {
+        if(_stream == nullptr || buffer == nullptr || size == 0) return;
+
+        EncoderType::StreamEncoder::encode(buffer, size, *_stream);
+        _stream->write(PacketMarker);
+    }
+
+    /// \brief Encode and send a packet made of several segments.
+    /// \param segments A pointer to a list of segments.
+    /// \param count The number of segments in the list.
+    /// \sa PacketSerial_::send()
+    void send(const PacketSegment* segments, size_t count) const
+    {
+        if(_stream == nullptr || segments == nullptr) return;
+        if(PacketSegment::totalSize(segments, count) == 0) return;
+
+        EncoderType::StreamEncoder::encode(segments, count, *_stream);
+        _stream->write(PacketMarker);
+    }
+
+private:
+    QueuedPacketSerial_(const QueuedPacketSerial_&);
+    QueuedPacketSerial_& operator = (const QueuedPacketSerial_&);
+
+    // Only the producer updates the counter, so it is stored atomically
+    // rather than incremented with a read-modify-write. See dropped() for
+    // the consumer side.
+    void countDropped()
+    {
+#if defined(__AVR__) || defined(ESP8266)
+        *static_cast<volatile size_t*>(&_dropped) = _dropped + 1;
+#else
+        __atomic_store_n(&_dropped, _dropped + 1, __ATOMIC_RELAXED);
+#endif
+    }
+
+    PacketRing_<SlotCount, SlotSize> _ring;
+
+    typename EncoderType::StreamDecoder _decoder;
+    uint8_t* _writeBuffer = nullptr;
+    size_t _writeIndex = 0;
+    bool _overflow = false;
+    size_t _dropped = 0;
+
+    Stream* _stream = nullptr;
+
+    PacketHandlerFunction _onPacketFunction = nullptr;
+    PacketHandlerFunctionWithSender _onPacketFunctionWithSender = nullptr;
+    void* _senderPtr = nullptr;
+};
+
+
+/// \brief A typedef for a queued PacketSerial type with COBS encoding.
+typedef QueuedPacketSerial_<COBS> QueuedPacketSerial;
+
+/// \brief A typedef for a queued PacketSerial type with SLIP encoding.
+typedef QueuedPacketSerial_<SLIP, SLIP::END> SLIPQueuedPacketSerial;
@@ -0,0 +1,451 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "PacketSerial.h"
+
+
+/// \brief A PacketSerial_ that retransmits lost packets and delivers them in
+///        order.
+///
+/// Packets are numbered and kept in a send window until the other end
+/// acknowledges them, so up to `WindowSize` packets can be in flight at once
+/// instead of waiting for an acknowledgement after each packet. Lost packets
+/// are resent when their retransmit timer expires, or as soon as an
+/// acknowledgement shows that a later packet arrived. The receiver holds
+/// packets that arrive out of order until the missing ones are resent
+/// (selective repeat):
+///
+///     ReliablePacketSerial myPacketSerial;
+///
+///     void setup()
+///     {
+///         myPacketSerial.begin(115200);
+///         myPacketSerial.setPacketHandler(&onPacketReceived);
+///     }
+///
+///     void loop()
+///     {
+///         myPacketSerial.update();
+///
+///         if (myPacketSerial.send(myPacket, sizeof(myPacket)))
+///         {
+///             // The packet will be delivered, unless the link fails.
+///         }
+///         else
+///         {
+///             // The send window is full. Try again later.
+///         }
+///     }
+///
+/// Each packet starts with a 5 byte header:
+///
+/// - The type, 1 for a data packet and 0 for an acknowledgement only.
+/// - The sequence number of a data packet.
+/// - The cumulative acknowledgement, i.e. the sequence number of the next
+///   packet expected in order.
+/// - A 16 bit little-endian bitmap of the packets after it that have been
+///   received out of order.
+///
+/// Acknowledgements are carried by data packets in the other direction. If
+/// `update()` receives data packets and has nothing to send, it sends an
+/// acknowledgement only packet.
+///
+/// The layer does not detect corrupted packets itself, so the
+/// `PacketSerialType` should use a `CheckedEncoder`, as it does by default.
+/// Both ends of a link must use the same window size and packet serial type,
+/// and both must call `reset()` if either of them restarts.
+///
+/// Sent and received packets are held in two pools of `WindowSize` packets of
+/// `MaxPacketSize` bytes each, so no memory is allocated.
+///
+/// \tparam PacketSerialType The PacketSerial_ type that sends the packets. It
+///         must accept packets of `MaxPacketSize + 5` bytes.
+/// \tparam WindowSize The number of packets that can be in flight: 1, 2, 4,
+///         8 or 16.
+/// \tparam MaxPacketSize The maximum number of bytes in a packet.
+template<typename PacketSerialType = PacketSerial_<CheckedEncoder<COBS, CRC16> >,
+         size_t WindowSize = 4,
+         size_t MaxPacketSize = 64>
+class ReliablePacketSerial_
+{
+public:
+    // Slots are indexed by sequence number modulo WindowSize, so WindowSize
+    // must divide the 256 sequence numbers.
+    static_assert(WindowSize > 0 && WindowSize <= 16 && 256 % WindowSize == 0,
+                  "WindowSize must be 1, 2, 4, 8 or 16.");
+
+    /// \brief A typedef describing the packet handler method.
+    /// \sa PacketSerial_::PacketHandlerFunction
+    typedef void (*PacketHandlerFunction)(const uint8_t* buffer, size_t size);
+
+    enum
+    {
+        /// \brief The number of header bytes added to each packet.
+        HeaderSize = 5
+    };
+
+    static_assert(MaxPacketSize + HeaderSize <= PacketSerialType::MaxDecodedSize,
+                  "PacketSerialType must accept packets of MaxPacketSize + 5 bytes.");
+
+    /// \brief Construct a ReliablePacketSerial_ without a stream.
+    ReliablePacketSerial_()
+    {
+        _packetSerial.setPacketHandler(&onPacketReceived, this);
+        reset();
+    }
+
+#if defined(ARDUINO)
+    /// \brief Begin a default serial connection with the given speed.
+    /// \param speed The serial data transmission speed in bits / second (baud).
+    /// \sa PacketSerial_::begin()
+    void begin(unsigned long speed)
+    {
+        _packetSerial.begin(speed);
+    }
+#endif
+
+    /// \brief Attach to an existing Arduino `Stream`.
+    /// \param stream A pointer to an Arduino `Stream`.
+    void setStream(Stream* stream)
+    {
+        _packetSerial.setStream(stream);
+    }
+
+    /// \brief Get the PacketSerial_ that sends the packets.
+    ///
+    /// Its packet handler is used to receive packets and must not be changed.
+    ///
+    /// \returns the PacketSerial_ instance.
+    PacketSerialType& getPacketSerial()
+    {
+        return _packetSerial;
+    }
+
+    /// \brief Set the function that will receive packets in order.
+    /// \param onPacketFunction A pointer to the packet handler function.
+    void setPacketHandler(PacketHandlerFunction onPacketFunction)
+    {
+        _onPacketFunction = onPacketFunction;
+    }
+
+    /// \brief Set the time after which an unacknowledged packet is resent.
+    ///
+    /// The timeout should be longer than the time it takes to send a packet
+    /// and receive its acknowledgement. The default is 100 ms.
+    ///
+    /// \param timeoutMicros The retransmit timeout in microseconds.
+    void setRetransmitTimeout(unsigned long timeoutMicros)
+    {
+        _retransmitTimeoutMicros = timeoutMicros;
+    }
+
+    /// \brief Forget all packets in flight and start again from sequence
+    ///        number 0.
+    void reset()
+    {
+        _sendBase = 0;
+        _sendNext = 0;
+        _receiveBase = 0;
+        _acknowledge = false;
+
+        for (size_t i = 0; i < WindowSize; i++)
+        {
+            _sendSlots[i].size = 0;
+            _sendSlots[i].acknowledged = true;
+            _sendSlots[i].fastRetransmitted = false;
+            _receiveSlots[i].size = 0;
+            _receiveSlots[i].received = false;
+        }
+    }
+
+    /// \brief Receive packets, send acknowledgements and resend packets whose
+    ///        retransmit timer expired.
+    /// \sa PacketSerial_::update()
+    void update()
+    {
+        _packetSerial.update();
+
+        unsigned long now = micros();
+
+        for (uint8_t sequence = _sendBase; sequence != _sendNext; sequence++)
+        {
+            SendSlot& slot = _sendSlots[sequence % WindowSize];
+
+            if (!slot.acknowledged && now - slot.sentMicros >= _retransmitTimeoutMicros)
+            {
+                transmit(sequence, now);
+                _retransmitted++;
+            }
+        }
+
+        if (_acknowledge)
+        {
+            uint8_t header[HeaderSize];
+            writeHeader(header, Acknowledgement, 0);
+            _packetSerial.send(header, HeaderSize);
+        }
+    }
+
+    /// \brief Send a packet.
+    ///
+    /// The packet is copied into the send window and sent. It is resent until
+    /// the other end acknowledges it.
+    ///
+    /// \param buffer A pointer to a data buffer.
+    /// \param size The number of bytes in the data buffer.
+    /// \returns false if the send window is full or the packet is larger than
+    ///          `MaxPacketSize`.
+    bool send(const uint8_t* buffer, size_t size)
+    {
+        if (size > MaxPacketSize || (size > 0 && buffer == nullptr) || !canSend())
+            return false;
+
+        uint8_t sequence = _sendNext++;
+        SendSlot& slot = _sendSlots[sequence % WindowSize];
+
+        memcpy(slot.data, buffer, size);
+        slot.size = size;
+        slot.acknowledged = false;
+        slot.fastRetransmitted = false;
+
+        transmit(sequence, micros());
+        return true;
+    }
+
+    /// \returns true if the send window has room for another packet.
+    bool canSend() const
+    {
+        return getUnacknowledgedCount() < WindowSize;
+    }
+
+    /// \returns the number of sent packets that have not been acknowledged.
+    size_t getUnacknowledgedCount() const
+    {
+        return static_cast<uint8_t>(_sendNext - _sendBase);
+    }
+
+    /// \returns the number of packets that were resent.
+    uint32_t retransmitted() const
+    {
+        return _retransmitted;
+    }
+
+    /// \returns the number of received packets that were dropped because
+    ///          they were malformed or outside the receive window.
+    uint32_t dropped() const
+    {
+        return _dropped;
+    }
+
+private:
+    ReliablePacketSerial_(const ReliablePacketSerial_&);
+    ReliablePacketSerial_& operator = (const ReliablePacketSerial_&);
+
+    enum
+    {
+        Acknowledgement = 0,
+        Data = 1
+    };
+
+    struct SendSlot
+    {
+        uint8_t data[MaxPacketSize];
+        size_t size;
+        unsigned long sentMicros;
+        bool acknowledged;
+        bool fastRetransmitted;
+    };
+
+    struct ReceiveSlot
+    {
+        uint8_t data[MaxPacketSize];
+        size_t size;
+        bool received;
+    };
+
+    static void onPacketReceived(const void* sender, const uint8_t* buffer, size_t size)
+    {
+        static_cast<ReliablePacketSerial_*>(const_cast<void*>(sender))->receive(buffer, size);
+    }
+
+    void writeHeader(uint8_t* header, uint8_t type, uint8_t sequence)
+    {
+        uint16_t bitmap = 0;
+
+        for (size_t i = 1; i < WindowSize; i++)
+        {
+            if (_receiveSlots[static_cast<uint8_t>(_receiveBase + i) % WindowSize].received)
+                bitmap |= static_cast<uint16_t>(1 << (i - 1));
+        }
+
+        header[0] = type;
+        header[1] = sequence;
+        header[2] = _receiveBase;
+        header[3] = static_cast<uint8_t>(bitmap);
+        header[4] = static_cast<uint8_t>(bitmap >> 8);
+
+        _acknowledge = false;
+    }
+
+    void transmit(uint8_t sequence, unsigned long now)
+    {
+        SendSlot& slot = _sendSlots[sequence % WindowSize];
+
+        uint8_t header[HeaderSize];
+        writeHeader(header, Data, sequence);
+
+        const PacketSegment segments[2] = {
+            { header, HeaderSize },
+            { slot.data, slot.size }
+        };
+
+        _packetSerial.send(segments, 2);
+        slot.sentMicros = now;
+    }
+
+    void receive(const uint8_t* buffer, size_t size)
+    {
+        if (size < HeaderSize || buffer[0] > Data)
+        {
+            // Empty packets, e.g. from repeated packet markers, are ignored.
+            if (size > 0)
+                _dropped++;
+
+            return;
+        }
+
+        acknowledge(buffer[2], buffer[3] | (static_cast<uint16_t>(buffer[4]) << 8));
+
+        if (buffer[0] == Data)
+            receiveData(buffer[1], buffer + HeaderSize, size - HeaderSize);
+    }
+
+    void acknowledge(uint8_t next, uint16_t bitmap)
+    {
+        uint8_t count = _sendNext - _sendBase;
+        uint8_t acknowledged = next - _sendBase;
+
+        // Ignore acknowledgements of packets that were not sent.
+        if (acknowledged > count)
+            return;
+
+        for (uint8_t i = 0; i < acknowledged; i++)
+        {
+            _sendSlots[static_cast<uint8_t>(_sendBase + i) % WindowSize].acknowledged = true;
+        }
+
+        // The offset of the last packet received out of order, if any.
+        uint8_t last = acknowledged;
+
+        for (size_t i = 1; i < WindowSize; i++)
+        {
+            uint8_t offset = static_cast<uint8_t>(acknowledged + i);
+
+            if (offset < count && (bitmap & (1 << (i - 1))))
+            {
+                _sendSlots[static_cast<uint8_t>(_sendBase + offset) % WindowSize].acknowledged = true;
+                last = offset;
+            }
+        }
+
+        // Packets before one that was received out of order were most likely
+        // lost, so resend them once without waiting for their timers.
+        unsigned long now = micros();
+
+        for (uint8_t offset = acknowledged; offset < last; offset++)
+        {
+            uint8_t sequence = _sendBase + offset;
+            SendSlot& slot = _sendSlots[sequence % WindowSize];
+
+            if (!slot.acknowledged && !slot.fastRetransmitted)
+            {
+                slot.fastRetransmitted = true;
+                transmit(sequence, now);
+                _retransmitted++;
+            }
+        }
+
+        while (_sendBase != _sendNext && _sendSlots[_sendBase % WindowSize].acknowledged)
+        {
+            _sendBase++;
+        }
+    }
+
+    void receiveData(uint8_t sequence, const uint8_t* buffer, size_t size)
+    {
+        // Always acknowledge data packets, so that the sender stops resending
+        // packets whose acknowledgement was lost.
+        _acknowledge = true;
+
+        uint8_t offset = sequence - _receiveBase;
+
+        if (offset >= WindowSize || size > MaxPacketSize)
+        {
+            // Packets just before the window were already delivered.
+            if (offset < 256 - WindowSize || size > MaxPacketSize)
+                _dropped++;
+
+            return;
+        }
+
+        ReceiveSlot& slot = _receiveSlots[sequence % WindowSize];
+
+        if (slot.received)
+            return;
+
+        if (offset > 0)
+        {
+            memcpy(slot.data, buffer, size);
+            slot.size = size;
+            slot.received = true;
+            return;
+        }
+
+        // The next packet in order is delivered without being copied.
+        _receiveBase++;
+        deliver(buffer, size);
+
+        while (_receiveSlots[_receiveBase % WindowSize].received)
+        {
+            ReceiveSlot& next = _receiveSlots[_receiveBase % WindowSize];
+            next.received = false;
+            _receiveBase++;
+            deliver(next.data, next.size);
+        }
+    }
+
+    void deliver(const uint8_t* buffer, size_t size)
+    {
+        if (_onPacketFunction)
+            _onPacketFunction(buffer, size);
+    }
+
+    PacketSerialType _packetSerial;
+
+    PacketHandlerFunction _onPacketFunction = nullptr;
+
+    SendSlot _sendSlots[WindowSize];
+    ReceiveSlot _receiveSlots[WindowSize];
+
+    uint8_t _sendBase = 0;
+    uint8_t _sendNext = 0;
+    uint8_t _receiveBase = 0;
+    bool _acknowledge = false;
+
+    unsigned long _retransmitTimeoutMicros = 100000;
+
+    uint32_t _retransmitted = 0;
+    uint32_t _dropped = 0;
+};
+
+
+/// \brief A ReliablePacketSerial_ over COBS with a CRC16, a window of 4
+///        packets and packets of up to 64 bytes.
+typedef ReliablePacketSerial_<> ReliablePacketSerial;
@@ -0,0 +1,148 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include <Arduino.h>
+
+
+/// \brief True if the byte order of the target is little-endian.
+///
+/// Defined from the compiler's `__BYTE_ORDER__` when available. All
+/// supported Arduino targets and most hosts are little-endian.
+#ifndef PACKETSERIAL_LITTLE_ENDIAN
+    #if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        #define PACKETSERIAL_LITTLE_ENDIAN 0
+    #else
+        #define PACKETSERIAL_LITTLE_ENDIAN 1
+    #endif
+#endif
+
+
+/// \brief A number stored in little-endian byte order with no alignment.
+///
+/// Use LittleEndian fields in structs that are sent as packets, so that the
+/// layout of the struct on the wire is the same on every target:
+///
+///     struct Position
+///     {
+///         uint8_t id;
+///         LittleEndian<int16_t> x;
+///         LittleEndian<int16_t> y;
+///         LittleEndian<float> heading;
+///     };
+///
+/// A LittleEndian<T> is `sizeof(T)` bytes with an alignment of 1, so a struct
+/// of LittleEndian fields and single bytes has no padding and can be read in
+/// place from a receive buffer. It converts to and from `T` implicitly. On
+/// little-endian targets the conversion is a plain copy, which the compiler
+/// reduces to a load or store.
+///
+/// \tparam T An integer or floating point type.
+template<typename T>
+class LittleEndian
+{
+public:
+    /// \brief Construct an uninitialized LittleEndian.
+    LittleEndian() = default;
+
+    /// \brief Construct a LittleEndian from a value.
+    /// \param value The value to store.
+    LittleEndian(T value)
+    {
+        set(value);
+    }
+
+    /// \brief Store a value.
+    /// \param value The value to store.
+    LittleEndian& operator = (T value)
+    {
+        set(value);
+        return *this;
+    }
+
+    /// \returns the stored value.
+    operator T() const
+    {
+        return get();
+    }
+
+    /// \returns the stored value.
+    T get() const
+    {
+        T value;
+#if PACKETSERIAL_LITTLE_ENDIAN
+        memcpy(&value, _bytes, sizeof(T));
+#else
+        uint8_t bytes[sizeof(T)];
+
+        for (size_t i = 0; i < sizeof(T); i++)
+        {
+            bytes[i] = _bytes[sizeof(T) - 1 - i];
+        }
+
+        memcpy(&value, bytes, sizeof(T));
+#endif
+        return value;
+    }
+
+    /// \brief Store a value.
+    /// \param value The value to store.
+    void set(T value)
+    {
+#if PACKETSERIAL_LITTLE_ENDIAN
+        memcpy(_bytes, &value, sizeof(T));
+#else
+        uint8_t bytes[sizeof(T)];
+        memcpy(bytes, &value, sizeof(T));
+
+        for (size_t i = 0; i < sizeof(T); i++)
+        {
+            _bytes[i] = bytes[sizeof(T) - 1 - i];
+        }
+#endif
+    }
+
+private:
+    uint8_t _bytes[sizeof(T)];
+};
+
+
+/// \brief View a received packet as a struct without copying it.
+///
+/// The packet is used in place, so the struct must be trivially copyable and
+/// have an alignment of 1, e.g. a struct of `uint8_t` and LittleEndian fields
+/// or a struct declared with `__attribute__((packed))`:
+///
+///     void onPacketReceived(const uint8_t* buffer, size_t size)
+///     {
+///         const Position* position = packetCast<Position>(buffer, size);
+///
+///         if (position)
+///         {
+///             int16_t x = position->x;
+///         }
+///     }
+///
+/// The returned pointer is only valid as long as the buffer, i.e. until the
+/// packet handler returns.
+///
+/// \tparam T The type of the struct.
+/// \param buffer A pointer to the decoded packet.
+/// \param size The number of bytes in the packet.
+/// \returns a pointer to the packet as a T, or nullptr if the size of the
+///          packet is not `sizeof(T)`.
+template<typename T>
+const T* packetCast(const uint8_t* buffer, size_t size)
+{
+    static_assert(alignof(T) == 1,
+                  "T must have an alignment of 1. Use LittleEndian fields or __attribute__((packed)).");
+    static_assert(__is_trivially_copyable(T), "T must be trivially copyable.");
+
+    return size == sizeof(T) ? reinterpret_cast<const T*>(buffer) : nullptr;
+}